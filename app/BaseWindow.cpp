@@ -18,7 +18,12 @@
 #include "BaseWindow.h"
 
 #include <mqueue.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+#include <algorithm>
+
+#include "../common/FrameScheduler.h"
 #include "../common/FrameTimeInfo.h"
 #include "../common/WindowUtils.h"
 #include "SurfaceTransaction.h"
@@ -47,9 +52,14 @@ Status BaseWindow::W::dispatchAppVisibility(bool visible) {
     return Status::ok();
 }
 
-Status BaseWindow::W::onFrame(int32_t seq) {
+Status BaseWindow::W::onFrame(int32_t seq, int64_t vsyncTime, int64_t expectedPresentTime,
+                              int64_t deadline) {
     if (mBaseWindow != nullptr) {
-        mBaseWindow->onFrame(seq);
+        FrameTimeline timeline;
+        timeline.mVsyncTime = vsyncTime;
+        timeline.mDeadline = deadline;
+        timeline.mExpectedPresentTime = expectedPresentTime;
+        mBaseWindow->onFrame(seq, timeline);
     }
     return Status::ok();
 }
@@ -74,11 +84,24 @@ BaseWindow::BaseWindow(::os::app::Context* context, WindowManager* wm)
       : mContext(context),
         mWindowManager(wm),
         mVsyncRequest(VsyncRequest::VSYNC_REQ_NONE),
+        mPeriodicRequest(VsyncRequest::VSYNC_REQ_PERIODIC),
         mAppVisible(false),
         mFrameDone(true),
         mSurfaceBufferReady(false),
         mTraceFrame(false),
-        mFrameTimeInfo(nullptr) {
+        mFrameTimeInfo(nullptr),
+        mFrameScheduler(new FrameScheduler()),
+        mEarlyFrameTimer(nullptr),
+        mEarlySeq(0),
+        mEarlyFrameTime(0),
+        mLastVsyncSeq(0) {
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+    mBufferStalls = 0;
+    mBufferIdleTimer = nullptr;
+#endif
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    mPrefaultIdle = nullptr;
+#endif
     if (mWindowManager == nullptr) {
         FLOGE("%p no valid window manager", this);
         return;
@@ -110,6 +133,7 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     auto newfreq = (mUIProxy.get() && mUIProxy->vsyncEventEnabled())
             ? VsyncRequest::VSYNC_REQ_PERIODIC
             : freq;
+    if (isPeriodicVsync(newfreq)) newfreq = mPeriodicRequest;
     if (mVsyncRequest == newfreq) {
         return false;
     }
@@ -117,8 +141,7 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     WM_PROFILER_BEGIN();
 
     if (mUIProxy->frameMetaInfo() && mFrameTimeInfo &&
-        (newfreq == VsyncRequest::VSYNC_REQ_PERIODIC ||
-         mVsyncRequest == VsyncRequest::VSYNC_REQ_PERIODIC)) {
+        (isPeriodicVsync(newfreq) || isPeriodicVsync(mVsyncRequest))) {
         static_cast<FrameTimeInfo*>(mFrameTimeInfo)->time(NULL);
     }
 
@@ -130,6 +153,16 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     return true;
 }
 
+void BaseWindow::setFrameRate(uint32_t frameRate) {
+    uint32_t period = mUIProxy.get() ? mUIProxy->getTimerPeriod() : 16;
+    mPeriodicRequest = periodicVsyncForRate(1000 / period, frameRate);
+    FLOGI("%p frame rate %" PRIu32 "Hz, vreq divisor %" PRIu32, this, frameRate,
+          vsyncDivisor(mPeriodicRequest));
+
+    /* a running animation switches right away */
+    if (isPeriodicVsync(mVsyncRequest)) scheduleVsync(mPeriodicRequest);
+}
+
 void* BaseWindow::getNativeDisplay() {
     return mUIProxy.get() != nullptr ? mUIProxy->getRoot() : nullptr;
 }
@@ -164,6 +197,29 @@ void BaseWindow::doDie() {
         delete static_cast<FrameTimeInfo*>(mFrameTimeInfo);
         mFrameTimeInfo = NULL;
     }
+    if (mFrameScheduler) {
+        delete mFrameScheduler;
+        mFrameScheduler = nullptr;
+    }
+    if (mEarlyFrameTimer) {
+        uv_close(reinterpret_cast<uv_handle_t*>(mEarlyFrameTimer),
+                 [](uv_handle_t* handle) { delete reinterpret_cast<uv_timer_t*>(handle); });
+        mEarlyFrameTimer = nullptr;
+    }
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+    if (mBufferIdleTimer) {
+        uv_close(reinterpret_cast<uv_handle_t*>(mBufferIdleTimer),
+                 [](uv_handle_t* handle) { delete reinterpret_cast<uv_timer_t*>(handle); });
+        mBufferIdleTimer = nullptr;
+    }
+#endif
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    if (mPrefaultIdle) {
+        uv_close(reinterpret_cast<uv_handle_t*>(mPrefaultIdle),
+                 [](uv_handle_t* handle) { delete reinterpret_cast<uv_idle_t*>(handle); });
+        mPrefaultIdle = nullptr;
+    }
+#endif
     mUIProxy.reset();
     mIWindow->clear();
 }
@@ -184,13 +240,26 @@ void BaseWindow::clearSurfaceBuffer() {
 #ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
     /*destroy current sc buffers */
     if (mSurfaceBufferReady) {
-        uninitSurfaceBuffer(mSurfaceControl);
+        uninitSurfaceBuffer(mSurfaceControl, false);
         mSurfaceBufferReady = false;
     }
 #endif
 }
 
 void BaseWindow::setSurfaceControl(SurfaceControl* surfaceControl) {
+    /* server kept the surface, keep current buffers and fmq mapping */
+    if (surfaceControl != nullptr && mSurfaceControl.get() != nullptr &&
+        surfaceControl->isValid() && mSurfaceControl->getHandle() == surfaceControl->getHandle()) {
+        FLOGI("%p keep surface %p", this, mSurfaceControl.get());
+#ifndef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
+        for (const auto& id : surfaceControl->bufferIds()) {
+            close(id.mFd);
+        }
+#endif
+        delete surfaceControl;
+        return;
+    }
+
     /*reset current buffer when surface changed*/
     mUIProxy->resetBuffer();
 
@@ -206,11 +275,22 @@ void BaseWindow::setSurfaceControl(SurfaceControl* surfaceControl) {
 #ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
         initSurfaceBuffer(mSurfaceControl, false);
         mSurfaceBufferReady = true;
+#else
+        /* buffers are mapped from fds, only the release ring needs mapping */
+        mSurfaceControl->initFMQ(false);
 #endif
     }
 }
 
-void BaseWindow::onFrame(int32_t seq) {
+void BaseWindow::dispatchVsync(int32_t seq, const FrameTimeline& timeline) {
+    uint32_t lastSeq = mLastVsyncSeq;
+    mLastVsyncSeq = seq;
+    if (vsyncDueSince(mVsyncRequest, lastSeq, seq)) {
+        onFrame(seq, timeline);
+    }
+}
+
+void BaseWindow::onFrame(int32_t seq, const FrameTimeline& timeline) {
     WM_PROFILER_BEGIN();
 
     mVsyncRequest = nextVsyncState(mVsyncRequest);
@@ -221,9 +301,38 @@ void BaseWindow::onFrame(int32_t seq) {
         return;
     }
 
+    /* the frame of this vsync has been started early, go on with the next one */
+    int64_t earlyFrameTime = mEarlyFrameTime;
+    mEarlyFrameTime = 0;
+    int64_t period = timeline.mExpectedPresentTime - timeline.mDeadline;
+    if (earlyFrameTime != 0 && llabs(timeline.mVsyncTime - earlyFrameTime) < period / 2) {
+        FLOGD("%p frame seq=%" PRIu32 " has been drawn early", this, seq);
+        scheduleEarlyFrame(seq, timeline);
+        WM_PROFILER_END();
+        return;
+    }
+
+    WM_PROFILER_END();
+    renderFrame(seq, timeline, false);
+}
+
+void BaseWindow::renderFrame(int32_t seq, const FrameTimeline& timeline, bool early) {
+    /* timers and animations run at the vsync time, then the frame is drawn */
+    mUIProxy->setFrameTime(timeline.mVsyncTime);
+    mWindowManager->runFrameTimers(timeline.mVsyncTime);
+    drawFrame(seq, timeline, early);
+    mUIProxy->setFrameTime(0);
+}
+
+void BaseWindow::drawFrame(int32_t seq, const FrameTimeline& timeline, bool early) {
+    WM_PROFILER_BEGIN();
+
     /* mark vsync */
     auto info = mUIProxy->frameMetaInfo();
-    if (info) info->setVsync(FrameMetaInfo::getCurSysTime(), seq, mUIProxy->getTimerPeriod());
+    if (info) {
+        info->setVsync(timeline.mVsyncTime / 1000, seq, mUIProxy->getTimerPeriod());
+        info->setFrameTimeline(timeline.mDeadline / 1000, timeline.mExpectedPresentTime / 1000);
+    }
     mUIProxy->notifyVsyncEvent();
 
     if (!mFrameDone.load(std::memory_order_acquire)) {
@@ -233,14 +342,29 @@ void BaseWindow::onFrame(int32_t seq) {
         return;
     }
 
+    /* a late frame would push the next one late as well, start clean on the next vsync */
+    if (!early && mFrameScheduler->shouldSkip(timeline, curSysTimeUs())) {
+        FLOGD("%p frame seq=%" PRIu32 ", can't make the deadline!", this, seq);
+        if (info) info->setSkipReason(FrameMetaSkipReason::DeadlineMissed);
+        if (!isPeriodicVsync(mVsyncRequest)) scheduleVsync(VsyncRequest::VSYNC_REQ_SINGLESUPPRESS);
+        WM_PROFILER_END();
+        return;
+    }
+
     /* mark draw start*/
-    if (info) info->markFrameStart();
+    if (info) {
+        info->markFrameStart();
+        mUIProxy->takeInputEvent(info);
+    }
 
     mFrameDone.exchange(false, std::memory_order_release);
     WM_PROFILER_END();
-    handleOnFrame(seq);
+    int64_t startTime = curSysTimeUs();
+    if (handleOnFrame(seq)) mFrameScheduler->addSample(curSysTimeUs() - startTime);
     mFrameDone.exchange(true, std::memory_order_release);
 
+    if (!early) scheduleEarlyFrame(seq, timeline);
+
     if (info) {
         /* mark frame finished*/
         info->markFrameFinished();
@@ -251,15 +375,58 @@ void BaseWindow::onFrame(int32_t seq) {
             FLOGI("SingleFrameLog{seq=%" PRIu32 ", skip=%d}", seq, (int)(*skipReason));
         } else {
             FLOGW("SingleFrameLog{seq=%" PRIu32 ", totalMs=%" PRId64 ", animMs=%" PRId64
-                  ", renderMs=%" PRId64 ", layoutMs=%" PRId64 ", transactMs=%" PRId64 "}",
+                  ", renderMs=%" PRId64 ", layoutMs=%" PRId64 ", transactMs=%" PRId64
+                  ", lateMs=%" PRId64 ", gainMs=%" PRId64 ", input=%" PRId64 ", inputMs=%" PRId64
+                  "}",
                   seq, info->totalDuration(), info->totalVsyncDuration(),
                   info->totalRenderDuration(), info->totalLayoutDuration(),
-                  info->totalTransactDuration());
+                  info->totalTransactDuration(), info->deadlineOverrun(), info->latencyGain(),
+                  info->get(FrameMetaIndex::InputId), info->inputLatency());
         }
         if (mFrameTimeInfo) static_cast<FrameTimeInfo*>(mFrameTimeInfo)->time(info);
     }
 }
 
+void BaseWindow::scheduleEarlyFrame(int32_t seq, const FrameTimeline& timeline) {
+    /* only a full rate animation knows its next vsync */
+    if (!isPeriodicVsync(mVsyncRequest) || vsyncDivisor(mVsyncRequest) != 1) {
+        return;
+    }
+
+    int64_t startTime = mFrameScheduler->earlyStartTime(timeline);
+    if (startTime == 0) {
+        return;
+    }
+
+    int64_t period = timeline.mExpectedPresentTime - timeline.mDeadline;
+    mEarlySeq = seq + 1;
+    mEarlyTimeline.mVsyncTime = timeline.mVsyncTime + period;
+    mEarlyTimeline.mDeadline = timeline.mDeadline + period;
+    mEarlyTimeline.mExpectedPresentTime = timeline.mExpectedPresentTime + period;
+
+    if (!mEarlyFrameTimer) {
+        mEarlyFrameTimer = new uv_timer_t;
+        uv_timer_init(mContext->getMainLoop()->get(), mEarlyFrameTimer);
+        mEarlyFrameTimer->data = this;
+    }
+
+    int64_t delay = startTime - (int64_t)curSysTimeUs();
+    uv_timer_start(
+            mEarlyFrameTimer,
+            [](uv_timer_t* handle) { static_cast<BaseWindow*>(handle->data)->onEarlyFrame(); },
+            delay > 0 ? delay / 1000 : 0, 0);
+}
+
+void BaseWindow::onEarlyFrame() {
+    if (!mAppVisible || !isPeriodicVsync(mVsyncRequest) || mUIProxy.get() == nullptr) {
+        return;
+    }
+
+    FLOGD("%p early frame seq=%" PRIu32 "", this, mEarlySeq);
+    mEarlyFrameTime = mEarlyTimeline.mVsyncTime;
+    renderFrame(mEarlySeq, mEarlyTimeline, true);
+}
+
 void BaseWindow::setVisible(bool visible) {
     FLOGI("%p visible from %d to %d", this, mAppVisible, visible);
 
@@ -288,13 +455,13 @@ void BaseWindow::setVisible(bool visible) {
     WM_PROFILER_END();
 }
 
-void BaseWindow::handleOnFrame(int32_t seq) {
+bool BaseWindow::handleOnFrame(int32_t seq) {
     auto info = mUIProxy->frameMetaInfo();
 
     if (!mAppVisible) {
         FLOGD("%p window needn't update.", this);
         if (info) info->setSkipReason(FrameMetaSkipReason::NoSurface);
-        return;
+        return false;
     }
 
     if (mSurfaceControl.get() == nullptr) {
@@ -308,22 +475,32 @@ void BaseWindow::handleOnFrame(int32_t seq) {
         if (buffProducer.get() == nullptr) {
             FLOGI("%p seq=%" PRIu32 " buffProducer is invalid!", this, seq);
             if (info) info->setSkipReason(FrameMetaSkipReason::NoBuffer);
-            return;
+            return false;
         }
 
-        BufferKey key;
-        if (mSurfaceControl->getFMQ().read(&(key))) {
-            bufferReleased(key);
-        }
+        bool recovered = false;
+        buffProducer->syncFreeState(mSurfaceControl->getFMQ(), &recovered);
+        if (recovered && info) info->addFlag(FrameMetaInfoFlags::BufferRecovered);
 
         BufferItem* item = buffProducer->dequeueBuffer();
         if (!item) {
-            if (mVsyncRequest != VsyncRequest::VSYNC_REQ_PERIODIC)
+            if (!isPeriodicVsync(mVsyncRequest))
                 scheduleVsync(VsyncRequest::VSYNC_REQ_SINGLESUPPRESS);
             FLOGI("%p seq=%" PRIu32 " no valid buffer!\n", this, seq);
             if (info) info->setSkipReason(FrameMetaSkipReason::NoBuffer);
-            return;
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+            /* producer keeps waiting for the server, try one more buffer */
+            if (++mBufferStalls >= CONFIG_WINDOW_BUFFER_GROW_STALLS &&
+                buffProducer->getBufferCount() < 3) {
+                updateBufferCount(3);
+            }
+#endif
+            return false;
         }
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+        /* only consecutive stalls ask for another buffer */
+        mBufferStalls = 0;
+#endif
 
         WM_PROFILER_BEGIN();
         mUIProxy->drawFrame(item);
@@ -332,10 +509,14 @@ void BaseWindow::handleOnFrame(int32_t seq) {
             FLOGI("%p seq=%" PRIu32 " no valid drawing!", this, seq);
             buffProducer->cancelBuffer(item);
             if (info) info->setSkipReason(FrameMetaSkipReason::NothingToDraw);
-            return;
+            return false;
         }
         if (info) info->markSyncQueued();
-        buffProducer->queueBuffer(item);
+        if (!buffProducer->queueBuffer(item)) {
+            FLOGI("%p seq=%" PRIu32 " buffer is gone from surface!", this, seq);
+            if (info) info->setSkipReason(FrameMetaSkipReason::NoBuffer);
+            return false;
+        }
 
         auto transaction = mWindowManager->getTransaction();
         transaction->setBuffer(mSurfaceControl, *item, seq);
@@ -345,11 +526,21 @@ void BaseWindow::handleOnFrame(int32_t seq) {
         FLOGI("%p seq=%" PRIu32 " apply frame transaction\n", this, seq);
         transaction->apply();
 
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+        /* window keeps drawing, have the next buffer mapped before it is dequeued */
+        if (isPeriodicVsync(mVsyncRequest)) schedulePrefault();
+#endif
+
         WindowEventListener* listener = mUIProxy->getEventListener();
         if (listener) {
             listener->onPostDraw();
         }
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+        restartBufferIdleTimer();
+#endif
+        return true;
     }
+    return false;
 }
 
 void BaseWindow::bufferReleased(int32_t bufKey) {
@@ -378,6 +569,91 @@ void BaseWindow::updateOrCreateBufferQueue() {
     FLOGI("%p updateOrCreateBufferQueue done!", this);
 }
 
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+void BaseWindow::updateBufferCount(uint32_t count) {
+    WM_PROFILER_BEGIN();
+    mBufferStalls = 0;
+
+    SurfaceControl surfaceControl;
+    int32_t result = 0;
+    Status status = mWindowManager->getService()->updateBufferCount(getIWindow(), count,
+                                                                    &surfaceControl, &result);
+    if (!status.isOk() || result != 0 ||
+        surfaceControl.getHandle() != mSurfaceControl->getHandle()) {
+        FLOGW("%p update buffer count to %" PRIu32 " failure!", this, count);
+#ifndef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
+        for (const auto& id : surfaceControl.bufferIds()) {
+            close(id.mFd);
+        }
+#endif
+        WM_PROFILER_END();
+        return;
+    }
+
+    /* release the draw buffers of removed items before they are unmapped */
+    auto buffProducer = getBufferProducer();
+    const auto& ids = surfaceControl.bufferIds();
+    for (const auto& id : mSurfaceControl->bufferIds()) {
+        auto it = std::find_if(ids.begin(), ids.end(),
+                               [&](const BufferId& cur) { return cur.mKey == id.mKey; });
+        if (it == ids.end() && buffProducer) {
+            mUIProxy->releaseBuffer(buffProducer->getBufferByKey(id.mKey));
+        }
+    }
+
+    mSurfaceControl->updateBufferIds(ids, false);
+    updateOrCreateBufferQueue();
+    FLOGI("%p buffer count is %" PRIu32 " now", this, getBufferProducer()->getBufferCount());
+    WM_PROFILER_END();
+}
+
+void BaseWindow::restartBufferIdleTimer() {
+    if (!mBufferIdleTimer) {
+        mBufferIdleTimer = new uv_timer_t;
+        uv_timer_init(mContext->getMainLoop()->get(), mBufferIdleTimer);
+        mBufferIdleTimer->data = this;
+    }
+    uv_timer_start(
+            mBufferIdleTimer,
+            [](uv_timer_t* handle) { static_cast<BaseWindow*>(handle->data)->onBufferIdle(); },
+            CONFIG_WINDOW_BUFFER_IDLE_MS, 0);
+}
+
+void BaseWindow::onBufferIdle() {
+    mBufferStalls = 0;
+
+    /* no frame for a while, give the third buffer back */
+    auto buffProducer = getBufferProducer();
+    if (buffProducer && buffProducer->getBufferCount() > 2) {
+        updateBufferCount(2);
+    }
+}
+#endif
+
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+void BaseWindow::schedulePrefault() {
+    if (!mPrefaultIdle) {
+        mPrefaultIdle = new uv_idle_t;
+        uv_idle_init(mContext->getMainLoop()->get(), mPrefaultIdle);
+        mPrefaultIdle->data = this;
+    }
+    /* runs once the frame callback returned, before the loop waits again */
+    uv_idle_start(mPrefaultIdle, [](uv_idle_t* handle) {
+        uv_idle_stop(handle);
+        static_cast<BaseWindow*>(handle->data)->onPrefault();
+    });
+}
+
+void BaseWindow::onPrefault() {
+    auto buffProducer = getBufferProducer();
+    if (buffProducer) {
+        WM_PROFILER_BEGIN();
+        buffProducer->prefaultBuffer();
+        WM_PROFILER_END();
+    }
+}
+#endif
+
 void BaseWindow::setEventListener(WindowEventListener* listener) {
     if (mUIProxy && mUIProxy.get()) mUIProxy->setEventListener(listener);
 }
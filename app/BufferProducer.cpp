@@ -26,17 +26,49 @@ BufferProducer::~BufferProducer() {}
 
 BufferItem* BufferProducer::dequeueBuffer() {
     BufferItem* bufferItem = getBuffer(BSLOT_FREE);
-    if (bufferItem != nullptr && toState(bufferItem, BSTATE_DEQUEUED)) {
+    if (bufferItem == nullptr) {
+        return nullptr;
+    }
+
+    /* first use of this buffer, allocate and map it now */
+    if (materialize(bufferItem, false) && toState(bufferItem, BSTATE_DEQUEUED)) {
         return bufferItem;
     }
     return nullptr;
 }
 
+uint32_t BufferProducer::syncFreeState(FakeFmq<BufferKey>& fmq, bool* recovered) {
+    BufferKey keys[BUFFER_QUEUE_MAX_SLOTS];
+    bool hadFree = hasFreeBuffer();
+    bool firstFreed = false;
+    uint32_t synced = 0;
+    uint32_t freed = 0;
+    uint32_t count;
+
+    while ((count = fmq.readBatch(keys, BUFFER_QUEUE_MAX_SLOTS)) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            bool result = syncFreeState(keys[i]) != nullptr;
+            if (synced++ == 0) firstFreed = result;
+            if (result) freed++;
+        }
+    }
+
+    if (recovered) *recovered = !hadFree && !firstFreed && freed > 0;
+    return freed;
+}
+
 bool BufferProducer::queueBuffer(BufferItem* buffer) {
-    if (buffer == nullptr) {
+    /* the surface doesn't know it any more, the frame would be dropped by the server */
+    if (buffer != nullptr && isRemoved(buffer)) {
+        cancelBuffer(buffer);
+        return false;
+    }
+
+    if (buffer == nullptr || !toState(buffer, BSTATE_QUEUED)) {
         return false;
     }
-    return toState(buffer, BSTATE_QUEUED);
+    updateAge(buffer);
+    return true;
 }
 
 } // namespace wm
@@ -18,8 +18,6 @@
 
 #include "wm/InputMonitor.h"
 
-#include <mqueue.h>
-
 #include "../common/WindowUtils.h"
 #include "WindowManager.h"
 #include "wm/InputMessage.h"
@@ -74,12 +72,7 @@ bool InputMonitor::receiveMessage(const InputMessage* msg) {
         return false;
     }
 
-    int fd = mInputChannel->getEventFd();
-    ssize_t size = mq_receive(fd, (char*)msg, sizeof(InputMessage), NULL);
-    if (size == sizeof(InputMessage)) {
-        return true;
-    }
-    return false;
+    return mInputChannel->receiveMessage(const_cast<InputMessage*>(msg));
 }
 
 bool InputMonitor::start(uv_loop_t* loop, InputMonitorCallback callback) {
@@ -21,6 +21,8 @@
 #include <lvgl/lvgl.h>
 #include <lvgl/src/lvgl_private.h>
 
+#include <algorithm>
+
 #include "../common/WindowUtils.h"
 
 namespace os {
@@ -29,6 +31,20 @@ static lv_display_t* _disp_init(LVGLDriverProxy* proxy, uint32_t width, uint32_t
                                 uint32_t cf);
 static lv_indev_t* _indev_init(LVGLDriverProxy* proxy);
 
+/* vsync time of the frame in progress in ms, 0 out of a frame */
+static uint32_t sFrameTick = 0;
+/* how late the last vsync was handled, wall time out of a frame is shifted by it so
+ * that reads between frames stay on the vsync time base */
+static uint32_t sFrameDelay = 0;
+static uint32_t sLastTick = 0;
+
+static uint32_t _frame_tick_cb(void) {
+    uint32_t tick = sFrameTick ? sFrameTick : (uint32_t)curSysTimeMs() - sFrameDelay;
+    /* never step back, lv_tick_elaps() would take it as a wrap around */
+    if ((int32_t)(tick - sLastTick) > 0) sLastTick = tick;
+    return sLastTick;
+}
+
 LVGLDrawBuffer::LVGLDrawBuffer(void* rawBuffer, uint32_t width, uint32_t height,
                                lv_color_format_t cf, uint32_t size) {
     uint32_t stride = lv_draw_buf_width_to_stride(width, cf);
@@ -45,7 +61,9 @@ LVGLDriverProxy::LVGLDriverProxy(std::shared_ptr<BaseWindow> win)
         mIndev(NULL),
         mRenderMode(CONFIG_APP_WINDOW_RENDER_MODE),
         mAllAreaDirty(true),
-        mPrevBuffer(NULL) {
+        mPrevBuffer(NULL),
+        mDamageHead(0),
+        mDamageCount(0) {
     lv_color_format_t cf = getLvColorFormatType(win->getLayoutParams().mFormat);
     auto wm = win->getWindowManager();
     uint32_t width = 0, height = 0;
@@ -109,11 +127,21 @@ void LVGLDriverProxy::onRenderStart() {
 
     mDisp->buf_act = (lv_draw_buf_t*)buffer;
 
-    if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT && mPrevBuffer && !mAllAreaDirty) {
-        lv_area_t area = {0, 0, mDispW - 1, mDispH - 1};
+    BufferItem* item = getBufferItem();
+    if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT && mPrevBuffer && !mAllAreaDirty &&
+        item != mPrevBuffer) {
+        /* only bring back what changed since this buffer was drawn */
+        Region damage;
+        if (!getDamage(item->mAge, &damage)) {
+            damage = Region(Rect(0, 0, mDispW - 1, mDispH - 1));
+        }
+
         WM_PROFILER_BEGIN();
-        lv_draw_buf_copy((lv_draw_buf_t*)buffer, &area, (lv_draw_buf_t*)(mPrevBuffer->mUserData),
-                         &area);
+        for (const auto& rect : damage) {
+            lv_area_t area = {rect.left, rect.top, rect.right, rect.bottom};
+            lv_draw_buf_copy((lv_draw_buf_t*)buffer, &area,
+                             (lv_draw_buf_t*)(mPrevBuffer->mUserData), &area);
+        }
         WM_PROFILER_END();
     }
 }
@@ -123,11 +151,36 @@ void LVGLDriverProxy::onRenderEnd() {
     if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT) {
         mPrevBuffer = getBufferItem();
 
-        lv_area_t area;
-        lv_display_get_dirty_area(mDisp, &area);
-        Rect inv_rect = Rect(area.x1, area.y1, area.x2, area.y2);
-        onRectCrop(inv_rect);
+        /* keep every invalidated area instead of their bounding box */
+        Region damage;
+        for (uint32_t i = 0; i < mDisp->inv_p; i++) {
+            if (mDisp->inv_area_joined[i]) continue;
+
+            const lv_area_t& area = mDisp->inv_areas[i];
+            damage.orSelf(Rect(area.x1, area.y1, area.x2, area.y2));
+        }
+        onRectCrop(damage);
+        addDamage(damage);
+    }
+}
+
+bool LVGLDriverProxy::getDamage(uint32_t age, Region* damage) {
+    /* content is undefined or older than the recorded frames */
+    if (age == 0 || age - 1 > mDamageCount) return false;
+
+    /* union of the frames queued after this buffer */
+    damage->clear();
+    for (uint32_t i = 1; i < age; i++) {
+        damage->orSelf(
+                mDamages[(mDamageHead + BUFFER_QUEUE_MAX_SLOTS - i) % BUFFER_QUEUE_MAX_SLOTS]);
     }
+    return true;
+}
+
+void LVGLDriverProxy::addDamage(const Region& damage) {
+    mDamages[mDamageHead] = damage;
+    mDamageHead = (mDamageHead + 1) % BUFFER_QUEUE_MAX_SLOTS;
+    if (mDamageCount < BUFFER_QUEUE_MAX_SLOTS) mDamageCount++;
 }
 
 void LVGLDriverProxy::onResolutionChanged(int32_t width, int32_t height) {
@@ -139,6 +192,7 @@ void LVGLDriverProxy::onResolutionChanged(int32_t width, int32_t height) {
 
     mDispW = width;
     mDispH = height;
+    clearDamage();
 
     WindowEventListener* listener = getEventListener();
     if (listener) {
@@ -207,9 +261,30 @@ void LVGLDriverProxy::resetBuffer() {
     mPrevBuffer = NULL;
     mDisp->buf_act = mDummyBuffer;
     mDrawBuffers.clear();
+    clearDamage();
     UIDriverProxy::resetBuffer();
 }
 
+void LVGLDriverProxy::releaseBuffer(BufferItem* item) {
+    if (!item) return;
+
+    if (mPrevBuffer == item) {
+        mPrevBuffer = NULL;
+        mAllAreaDirty = true;
+    }
+
+    if (item->mUserData) {
+        if (mDisp->buf_act == item->mUserData) mDisp->buf_act = mDummyBuffer;
+        auto it = std::find_if(mDrawBuffers.begin(), mDrawBuffers.end(),
+                               [item](const std::shared_ptr<LVGLDrawBuffer>& drawBuffer) {
+                                   return drawBuffer->getDrawBuffer() == item->mUserData;
+                               });
+        if (it != mDrawBuffers.end()) mDrawBuffers.erase(it);
+        item->mUserData = nullptr;
+    }
+    UIDriverProxy::releaseBuffer(item);
+}
+
 void LVGLDriverProxy::updateResolution(int32_t width, int32_t height, uint32_t format) {
     lv_color_format_t color_format = getLvColorFormatType(format);
     FLOGI("%p update resolution (%" PRId32 "x%" PRId32 ") format %" PRId32 "->%d", this, width,
@@ -235,6 +310,18 @@ void LVGLDriverProxy::updateVisibility(bool visible) {
     }
 }
 
+void LVGLDriverProxy::setFrameTime(int64_t vsyncTime) {
+    if (vsyncTime <= 0) {
+        sFrameTick = 0;
+        return;
+    }
+
+    sFrameTick = (uint32_t)(vsyncTime / 1000);
+    /* an early frame runs ahead of its vsync, no delay then */
+    int32_t delay = (int32_t)((uint32_t)curSysTimeMs() - sFrameTick);
+    sFrameDelay = delay > 0 ? delay : 0;
+}
+
 void LVGLDriverProxy::notifyVsyncEvent() {
     if (vsyncEventEnabled()) {
         FLOGI("send vsync event");
@@ -416,6 +503,8 @@ void LVGLDriverProxy::init() {
 #if LV_USE_NUTTX
     lv_nuttx_init(NULL, NULL);
 #endif
+    /* animations of a frame are timed by its vsync instead of the wakeup */
+    lv_tick_set_cb(_frame_tick_cb);
 
 #ifdef CONFIG_UIKIT
     vg_init();
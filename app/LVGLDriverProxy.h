@@ -59,6 +59,7 @@ public:
     void updateVisibility(bool visible) override;
     void* onDequeueBuffer() override;
     void resetBuffer() override;
+    void releaseBuffer(BufferItem* item) override;
 
     bool updateDirtyArea(const lv_area_t* area);
     void onResolutionChanged(int32_t width, int32_t height);
@@ -78,6 +79,7 @@ public:
     }
 
     void notifyVsyncEvent() override;
+    void setFrameTime(int64_t vsyncTime) override;
 
     uint32_t getTimerPeriod() override {
         return LV_DEF_REFR_PERIOD;
@@ -95,6 +97,12 @@ public:
     }
 
 private:
+    bool getDamage(uint32_t age, Region* damage);
+    void addDamage(const Region& damage);
+    void clearDamage() {
+        mDamageCount = 0;
+    }
+
     lv_display_t* mDisp;
 
     int32_t mDispW;
@@ -106,6 +114,11 @@ private:
     ::std::vector<std::shared_ptr<LVGLDrawBuffer>> mDrawBuffers;
     bool mAllAreaDirty;
     BufferItem* mPrevBuffer;
+
+    /* dirty areas of the latest frames, for copying back a buffer by its age */
+    Region mDamages[BUFFER_QUEUE_MAX_SLOTS];
+    uint32_t mDamageHead;
+    uint32_t mDamageCount;
 };
 
 } // namespace wm
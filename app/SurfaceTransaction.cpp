@@ -45,12 +45,12 @@ SurfaceTransaction& SurfaceTransaction::setBuffer(const std::shared_ptr<SurfaceC
 }
 
 SurfaceTransaction& SurfaceTransaction::setBufferCrop(const std::shared_ptr<SurfaceControl>& sc,
-                                                      Rect& rect) {
+                                                      const Region& region) {
     LayerState* state = getLayerState(sc);
 
     if (state != nullptr) {
         state->mFlags |= LayerState::LAYER_BUFFER_CROP_CHANGED;
-        state->mBufferCrop = rect;
+        state->mBufferCrop = region;
     }
     return *this;
 }
@@ -23,6 +23,7 @@
 
 #include "WindowManager.h"
 #include "wm/BufferQueue.h"
+#include "wm/Region.h"
 
 namespace os {
 namespace wm {
@@ -48,7 +49,8 @@ public:
 
     SurfaceTransaction& setBuffer(const std::shared_ptr<SurfaceControl>& sc, BufferItem& item,
                                   uint32_t seq);
-    SurfaceTransaction& setBufferCrop(const std::shared_ptr<SurfaceControl>& sc, Rect& rect);
+    SurfaceTransaction& setBufferCrop(const std::shared_ptr<SurfaceControl>& sc,
+                                      const Region& region);
 
     SurfaceTransaction& setPosition(const std::shared_ptr<SurfaceControl>& sc, int32_t x,
                                     int32_t y);
@@ -29,7 +29,9 @@ UIDriverProxy::UIDriverProxy(std::shared_ptr<BaseWindow> win)
         mFlags(0),
         mInputMonitor(nullptr),
         mEventListener(nullptr),
-        mVsyncEnabled(false) {}
+        mVsyncEnabled(false),
+        mInputSeq(0),
+        mInputTime(0) {}
 
 UIDriverProxy::~UIDriverProxy() {
     mBufferItem = nullptr;
@@ -45,12 +47,12 @@ bool UIDriverProxy::onInvalidate(bool periodic) {
     return false;
 }
 
-void UIDriverProxy::onRectCrop(Rect& rect) {
+void UIDriverProxy::onRectCrop(const Region& region) {
     mFlags |= UIP_BUFFER_RECT_UPDATE;
-    mRectCrop = rect;
+    mRectCrop = region;
 }
 
-Rect* UIDriverProxy::rectCrop() {
+Region* UIDriverProxy::rectCrop() {
     return ((mFlags & UIP_BUFFER_RECT_UPDATE) == UIP_BUFFER_RECT_UPDATE) ? &mRectCrop : nullptr;
 }
 
@@ -81,12 +83,21 @@ void UIDriverProxy::setInputMonitor(InputMonitor* monitor) {
 }
 
 bool UIDriverProxy::readEvent(InputMessage* message) {
-    if (message && mInputMonitor) {
-        return mInputMonitor->receiveMessage(message);
+    if (message && mInputMonitor && mInputMonitor->receiveMessage(message)) {
+        mInputSeq = message->seq;
+        mInputTime = message->timestamp;
+        return true;
     }
     return false;
 }
 
+void UIDriverProxy::takeInputEvent(FrameMetaInfo* info) {
+    if (mInputSeq == 0) return;
+
+    info->setInputEvent(mInputSeq, mInputTime / 1000);
+    mInputSeq = 0;
+}
+
 void UIDriverProxy::updateResolution(int32_t width, int32_t height, uint32_t format) {}
 
 void UIDriverProxy::updateVisibility(bool visible) {}
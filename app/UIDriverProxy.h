@@ -21,7 +21,7 @@
 #include "wm/BufferQueue.h"
 #include "wm/InputMessage.h"
 #include "wm/InputMonitor.h"
-#include "wm/Rect.h"
+#include "wm/Region.h"
 
 namespace os {
 namespace wm {
@@ -46,8 +46,8 @@ public:
     bool onQueueBuffer();
     void onCancelBuffer();
 
-    void onRectCrop(Rect& rect);
-    Rect* rectCrop();
+    void onRectCrop(const Region& region);
+    Region* rectCrop();
 
     BufferItem* getBufferItem() {
         return mBufferItem;
@@ -55,6 +55,8 @@ public:
 
     virtual void handleEvent() = 0;
     bool readEvent(InputMessage* message);
+    /* the input read since the last frame goes with the frame showing it */
+    void takeInputEvent(FrameMetaInfo* info);
     virtual void setInputMonitor(InputMonitor* monitor);
     InputMonitor* getInputMonitor() {
         return mInputMonitor;
@@ -77,6 +79,11 @@ public:
         mBufferItem = nullptr;
     }
 
+    /* the buffer is going to be removed from queue */
+    virtual void releaseBuffer(BufferItem* item) {
+        if (mBufferItem == item) mBufferItem = nullptr;
+    }
+
     virtual void updateVisibility(bool visible);
 
     bool vsyncEventEnabled() {
@@ -84,6 +91,8 @@ public:
     }
     void onFBVsyncRequest(bool enable);
     virtual void notifyVsyncEvent() {}
+    /* clock of the frame in us, 0 goes back to the real clock */
+    virtual void setFrameTime(int64_t vsyncTime) {}
     virtual uint32_t getTimerPeriod() {
         return 16;
     }
@@ -98,11 +107,13 @@ public:
 private:
     std::weak_ptr<BaseWindow> mBaseWindow;
     BufferItem* mBufferItem;
-    Rect mRectCrop;
+    Region mRectCrop;
     int8_t mFlags;
     InputMonitor* mInputMonitor;
     WindowEventListener* mEventListener;
     bool mVsyncEnabled;
+    uint32_t mInputSeq;
+    uint64_t mInputTime;
 
     bool mTraceFrame;
     FrameMetaInfo mFrameMetaInfo;
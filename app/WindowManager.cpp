@@ -107,7 +107,14 @@ void WindowManager::releaseInput(InputMonitor* monitor) {
     FLOGI("success");
 }
 
-WindowManager::WindowManager() : mService(nullptr), mTimerInited(false) {
+WindowManager::WindowManager()
+      : mService(nullptr),
+        mTimerInited(false),
+        mTimerSleep(UI_PROXY_TIMER_READY),
+        mTimerVsyncTime(0) {
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    mVsyncPoll = nullptr;
+#endif
     mTransaction = std::make_shared<SurfaceTransaction>();
     mTransaction->setWindowManager(this);
     getService();
@@ -151,6 +158,9 @@ std::shared_ptr<BaseWindow> WindowManager::newWindow(::os::app::Context* context
         FLOGD("init event timer.");
         /* for video feature */
         vg_uv_init(context->getMainLoop()->get());
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+        startVsyncChannel(context->getMainLoop()->get());
+#endif
         mTimerInited = true;
     }
 
@@ -228,6 +238,9 @@ bool WindowManager::removeWindow(std::shared_ptr<BaseWindow> window) {
             mTimerInited = false;
             FLOGD("close event timer.");
             vg_uv_deinit();
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+            stopVsyncChannel();
+#endif
         }
     }
     WM_PROFILER_END();
@@ -238,6 +251,92 @@ bool WindowManager::removeWindow(std::shared_ptr<BaseWindow> window) {
 
 void WindowManager::toBackground() {}
 
+void WindowManager::runFrameTimers(int64_t vsyncTime) {
+    /* the windows of a vsync tick share one timer run */
+    if (!mTimerInited || vsyncTime == mTimerVsyncTime) return;
+    mTimerVsyncTime = vsyncTime;
+
+    uv_timer_stop(&mEventTimer);
+    mTimerSleep = LVGLDriverProxy::timerHandler();
+    if (mTimerSleep == UI_PROXY_TIMER_READY) return;
+
+    /* the event timer stays armed, it takes over when no further frame comes */
+    uv_timer_start(&mEventTimer, _wm_timer_cb, mTimerSleep > 0 ? mTimerSleep : 1, 0);
+}
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+void WindowManager::startVsyncChannel(uv_loop_t* loop) {
+    mVsyncToken = sp<BBinder>::make();
+    Status status = mService->registerVsyncChannel(mVsyncToken, &mVsyncChannel);
+    if (!status.isOk()) {
+        FLOGW("no vsync channel, frames are sent by binder");
+        mVsyncToken = nullptr;
+        return;
+    }
+
+    /* fall back to binder, service must not signal a channel nobody reads */
+    if (!mVsyncChannel.map()) {
+        FLOGE("map vsync channel failure");
+        stopVsyncChannel();
+        return;
+    }
+
+    mVsyncPoll = new uv_poll_t;
+    mVsyncPoll->data = this;
+    int ret = uv_poll_init(loop, mVsyncPoll, mVsyncChannel.getEventFd());
+    if (ret != 0) {
+        FLOGE("init vsync channel failure:%d", ret);
+        delete mVsyncPoll;
+        mVsyncPoll = nullptr;
+        stopVsyncChannel();
+        return;
+    }
+
+    ret = uv_poll_start(mVsyncPoll, UV_READABLE, [](uv_poll_t* handle, int status, int events) {
+        WindowManager* wm = static_cast<WindowManager*>(handle->data);
+        if (status == 0 && (events & UV_READABLE) && wm) {
+            wm->dispatchVsync();
+        }
+    });
+    if (ret != 0) {
+        FLOGE("start vsync channel failure:%d", ret);
+        stopVsyncChannel();
+        return;
+    }
+    FLOGI("start vsync channel(%d) success", mVsyncChannel.getEventFd());
+}
+
+void WindowManager::stopVsyncChannel() {
+    if (mVsyncPoll) {
+        uv_poll_stop(mVsyncPoll);
+        mVsyncPoll->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(mVsyncPoll),
+                 [](uv_handle_t* handle) { delete reinterpret_cast<uv_poll_t*>(handle); });
+        mVsyncPoll = nullptr;
+    }
+
+    if (mVsyncToken) {
+        mService->unregisterVsyncChannel(mVsyncToken);
+        mVsyncToken = nullptr;
+    }
+    mVsyncChannel.release();
+}
+
+void WindowManager::dispatchVsync() {
+    uint32_t seq = 0;
+    FrameTimeline timeline;
+    if (!mVsyncChannel.receive(&seq, &timeline)) {
+        return;
+    }
+
+    /* by index, a window may be removed in its frame callback */
+    for (size_t i = 0; i < mWindows.size(); i++) {
+        auto window = mWindows[i];
+        window->dispatchVsync(seq, timeline);
+    }
+}
+#endif
+
 bool WindowManager::dumpWindows() {
     int number = 0;
     for (const auto& ptr : mWindows) {
@@ -18,6 +18,10 @@
 #include "wm/BufferQueue.h"
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "WindowUtils.h"
 #include "wm/SurfaceControl.h"
@@ -25,7 +29,9 @@
 namespace os {
 namespace wm {
 
-BufferQueue::BufferQueue(const std::shared_ptr<SurfaceControl>& sc) {
+BufferQueue::BufferQueue(const std::shared_ptr<SurfaceControl>& sc)
+      : mUsedSlots(0), mRemovedSlots(0), mBufferCount(0) {
+    resetSlots();
     update(sc);
 }
 
@@ -33,17 +39,17 @@ BufferQueue::~BufferQueue() {
     mSurfaceControl.reset();
 
     FLOGI(" ");
-    if (!mBuffers.empty()) {
+    if (mBufferCount > 0) {
         clearBuffers();
     }
-
-    mDataSlot.clear();
-    mFreeSlot.clear();
 }
 
 BufferItem* BufferQueue::getBuffer(BufferKey bufKey) {
-    if (mBuffers.find(bufKey) != mBuffers.end()) {
-        return &mBuffers[bufKey];
+    // bounded by BUFFER_QUEUE_MAX_SLOTS
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        if (isUsed(i) && mBuffers[i].mKey == bufKey) {
+            return &mBuffers[i];
+        }
     }
     return nullptr;
 }
@@ -53,21 +59,163 @@ bool BufferQueue::cancelBuffer(BufferItem* item) {
     return toState(item, BSTATE_FREE);
 }
 
-void BufferQueue::clearBuffers() {
-    for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        it->second.mUserData = nullptr;
+BufferKey BufferQueue::getFreeKey() {
+    BufferItem* item = getBuffer(BSLOT_FREE);
+    return item ? item->mKey : -1;
+}
+
+void BufferQueue::removeBuffer(int32_t index) {
+    BufferItem* item = &mBuffers[index];
+    item->mUserData = nullptr;
+
+    FLOGI("now unmap and close shared memory for %d", item->mFd);
+
+    if (item->mBuffer && munmap(item->mBuffer, item->mSize) == -1) {
+        FLOGE("failed to unmap shared memory for %d", item->mFd);
+    }
+
+    if (close(item->mFd) == -1) {
+        FLOGE("failed to close shared memory for %d", item->mFd);
+    }
+
+    item->mBuffer = nullptr;
+    item->mFd = -1;
+    mUsedSlots &= ~(1u << index);
+    mRemovedSlots &= ~(1u << index);
+    mBufferCount--;
+}
+
+bool BufferQueue::addBuffer(const BufferId& id, uint32_t size) {
+    if (id.mFd == -1 || mBufferCount >= BUFFER_QUEUE_MAX_SLOTS) {
+        return false;
+    }
+
+    int32_t index = 0;
+    while (isUsed(index)) {
+        index++;
+    }
+
+    mBuffers[index] = {id.mKey, id.mFd, nullptr, size, BSTATE_FREE, nullptr, 0};
+#ifndef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    if (!materialize(&mBuffers[index], false)) {
+        return false;
+    }
+#endif
+
+    mUsedSlots |= 1u << index;
+    mBufferCount++;
+    pushSlot(BSLOT_FREE, index);
+    return true;
+}
+
+bool BufferQueue::materialize(BufferItem* item, bool prefault) {
+    if (item->mBuffer) {
+        return true;
+    }
 
-        FLOGI("now unmap and close shared memory for %d", it->second.mFd);
+    /* the creator may leave the buffer empty until it is really used */
+    struct stat st;
+    if (fstat(item->mFd, &st) == 0 && st.st_size < (off_t)item->mSize &&
+        ftruncate(item->mFd, item->mSize) == -1) {
+        FLOGE("failed to resize shared memory for %d, size=%" PRIu32 "", item->mFd, item->mSize);
+        return false;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (prefault) flags |= MAP_POPULATE;
+#endif
+    void* buffer = mmap(nullptr, item->mSize, PROT_READ | PROT_WRITE, flags, item->mFd, 0);
+    if (buffer == MAP_FAILED) {
+        FLOGE("failed to map shared memory for %d", item->mFd);
+        return false;
+    }
+
+    FLOGI("map shared memory success for %d%s", item->mFd, prefault ? ", prefault" : "");
+    item->mBuffer = buffer;
+    return true;
+}
+
+BufferItem* BufferQueue::getUnmappedBuffer() {
+    for (int32_t i = mSlots[BSLOT_FREE].mHead; i >= 0; i = mSlotLinks[i].mNext) {
+        if (mBuffers[i].mBuffer == nullptr) {
+            return &mBuffers[i];
+        }
+    }
+    return nullptr;
+}
 
-        if (it->second.mBuffer && munmap(it->second.mBuffer, it->second.mSize) == -1) {
-            FLOGE("failed to unmap shared memory for %d", it->second.mFd);
+void BufferQueue::clearBuffers() {
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        if (isUsed(i)) {
+            removeBuffer(i);
         }
+    }
+    resetSlots();
+}
 
-        if (close(it->second.mFd) == -1) {
-            FLOGE("failed to close shared memory for %d", it->second.mFd);
+void BufferQueue::reset() {
+    resetSlots();
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        if (isUsed(i) && (mRemovedSlots & (1u << i))) {
+            removeBuffer(i);
+        } else if (isUsed(i)) {
+            mBuffers[i].mState = BSTATE_FREE;
+            mBuffers[i].mAge = 0;
+            pushSlot(BSLOT_FREE, i);
         }
     }
-    mBuffers.clear();
+}
+
+void BufferQueue::resetSlots() {
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        mSlotLinks[i] = {-1, -1, -1};
+    }
+    mSlots[BSLOT_FREE] = {-1, -1};
+    mSlots[BSLOT_DATA] = {-1, -1};
+}
+
+int32_t BufferQueue::slotIndex(const BufferItem* item) const {
+    if (item < mBuffers || item >= mBuffers + BUFFER_QUEUE_MAX_SLOTS) {
+        return -1;
+    }
+
+    int32_t index = static_cast<int32_t>(item - mBuffers);
+    return isUsed(index) ? index : -1;
+}
+
+void BufferQueue::pushSlot(BufferSlot slot, int32_t index) {
+    SlotFifo& fifo = mSlots[slot];
+    SlotLink& link = mSlotLinks[index];
+
+    link.mPrev = fifo.mTail;
+    link.mNext = -1;
+    link.mOwner = slot;
+
+    if (fifo.mTail != -1) {
+        mSlotLinks[fifo.mTail].mNext = index;
+    } else {
+        fifo.mHead = index;
+    }
+    fifo.mTail = index;
+}
+
+void BufferQueue::removeSlot(BufferSlot slot, int32_t index) {
+    SlotFifo& fifo = mSlots[slot];
+    SlotLink& link = mSlotLinks[index];
+
+    if (link.mPrev != -1) {
+        mSlotLinks[link.mPrev].mNext = link.mNext;
+    } else {
+        fifo.mHead = link.mNext;
+    }
+
+    if (link.mNext != -1) {
+        mSlotLinks[link.mNext].mPrev = link.mPrev;
+    } else {
+        fifo.mTail = link.mPrev;
+    }
+    link = {-1, -1, -1};
 }
 
 BufferItem* BufferQueue::syncState(BufferKey key, BufferState byState) {
@@ -86,10 +234,10 @@ BufferItem* BufferQueue::syncState(BufferKey key, BufferState byState) {
 
 bool BufferQueue::update(const std::shared_ptr<SurfaceControl>& sc) {
     if (sc->isSameSurface(sc, mSurfaceControl.lock())) {
-        return false;
+        return syncBuffers(sc);
     }
 
-    if (!mBuffers.empty()) {
+    if (mBufferCount > 0) {
         clearBuffers();
     }
 
@@ -98,54 +246,104 @@ bool BufferQueue::update(const std::shared_ptr<SurfaceControl>& sc) {
     auto bufferIds = sc->bufferIds();
     uint32_t size = sc->getBufferSize();
 
-    for (const auto& id : bufferIds) {
-        BufferKey bufferkey = id.mKey;
-        int bufferFd = id.mFd;
+    if (bufferIds.size() > BUFFER_QUEUE_MAX_SLOTS) {
+        FLOGE("too many buffers %zu, max is %d", bufferIds.size(), BUFFER_QUEUE_MAX_SLOTS);
+        return false;
+    }
 
-        if (bufferFd == -1) {
+    for (const auto& id : bufferIds) {
+        if (!addBuffer(id, size)) {
             return false;
         }
+    }
+    return true;
+}
 
-        void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, bufferFd, 0);
+bool BufferQueue::syncBuffers(const std::shared_ptr<SurfaceControl>& sc) {
+    auto bufferIds = sc->bufferIds();
+    bool changed = false;
 
-        if (buffer == MAP_FAILED) {
-            FLOGE("failed to map shared memory for %d", bufferFd);
-            return false;
+    /* drop buffers removed from surface, a dequeued or acquired one once it is free */
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        if (!isUsed(i)) continue;
+
+        auto it = std::find_if(bufferIds.begin(), bufferIds.end(),
+                               [&](const BufferId& id) { return id.mKey == mBuffers[i].mKey; });
+        if (it != bufferIds.end()) {
+            mRemovedSlots &= ~(1u << i);
+            continue;
         }
 
-        FLOGI("map shared memory success for %d", bufferFd);
-        BufferItem buffItem = {bufferkey, bufferFd, buffer, size, BSTATE_FREE, nullptr};
-        mBuffers[bufferkey] = buffItem;
-        mFreeSlot.push_back(bufferkey);
+        if (mBuffers[i].mState == BSTATE_DEQUEUED || mBuffers[i].mState == BSTATE_ACQUIRED) {
+            FLOGI("buffer %" PRId32 " is in use, remove it once it is free", mBuffers[i].mKey);
+            mRemovedSlots |= 1u << i;
+            continue;
+        }
+
+        if (inSlot(BSLOT_FREE, i)) removeSlot(BSLOT_FREE, i);
+        if (inSlot(BSLOT_DATA, i)) removeSlot(BSLOT_DATA, i);
+        removeBuffer(i);
+        changed = true;
     }
-    return true;
+
+    /* map buffers added to surface */
+    for (const auto& id : bufferIds) {
+        if (!getBuffer(id.mKey) && addBuffer(id, sc->getBufferSize())) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void BufferQueue::updateAge(BufferItem* drawn) {
+    for (int32_t i = 0; i < BUFFER_QUEUE_MAX_SLOTS; i++) {
+        if (isUsed(i) && mBuffers[i].mAge > 0) {
+            mBuffers[i].mAge++;
+        }
+    }
+    drawn->mAge = 1;
 }
 
 bool BufferQueue::toState(BufferItem* item, BufferState state) {
+    if (!moveState(item, state)) {
+        return false;
+    }
+
+    int32_t index = slotIndex(item);
+    if (state == BSTATE_FREE && (mRemovedSlots & (1u << index))) {
+        removeSlot(BSLOT_FREE, index);
+        removeBuffer(index);
+    }
+    return true;
+}
+
+bool BufferQueue::moveState(BufferItem* item, BufferState state) {
     /*
      * PRODUCER: FREE <-> DEQUEUED -> QUEUED -> FREE
      * CONSUMER: FREE <-> QUEUED -> ACQUIRED -> FREE
      */
+    int32_t index = slotIndex(item);
+    if (index < 0) {
+        return false;
+    }
+
     switch (item->mState) {
         case BSTATE_FREE:
             if (state == BSTATE_DEQUEUED) {
-                // check it in free slot
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it == mFreeSlot.end()) {
+                // remove from free slot and update state
+                if (!inSlot(BSLOT_FREE, index)) {
                     return false;
                 }
-                // remove from free slot and update state
-                mFreeSlot.remove(item->mKey);
+                removeSlot(BSLOT_FREE, index);
                 item->mState = state;
                 return true;
             } else if (state == BSTATE_QUEUED) {
                 // move it from free slot to data slot
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it == mFreeSlot.end()) {
+                if (!inSlot(BSLOT_FREE, index)) {
                     return false;
                 }
-                mFreeSlot.remove(item->mKey);
-                mDataSlot.push_back(item->mKey);
+                removeSlot(BSLOT_FREE, index);
+                pushSlot(BSLOT_DATA, index);
                 item->mState = state;
                 return true;
             }
@@ -154,20 +352,18 @@ bool BufferQueue::toState(BufferItem* item, BufferState state) {
         case BSTATE_DEQUEUED:
             if (state == BSTATE_QUEUED) {
                 // move to data slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it != mDataSlot.end()) {
+                if (inSlot(BSLOT_DATA, index)) {
                     return false;
                 }
-                mDataSlot.push_back(item->mKey);
+                pushSlot(BSLOT_DATA, index);
                 item->mState = state;
                 return true;
             } else if (state == BSTATE_FREE) {
                 // move to free slot and update state
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it != mFreeSlot.end()) {
+                if (inSlot(BSLOT_FREE, index)) {
                     return false;
                 }
-                mFreeSlot.push_back(item->mKey);
+                pushSlot(BSLOT_FREE, index);
                 item->mState = state;
                 return true;
             }
@@ -178,28 +374,16 @@ bool BufferQueue::toState(BufferItem* item, BufferState state) {
                 // update state, buffer in data slot
                 item->mState = state;
                 return true;
-            } else if (state == BSTATE_FREE) {
-                // move it from data slot to free slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it == mDataSlot.end()) {
-                    return false;
-                }
-                mDataSlot.remove(item->mKey);
-                mFreeSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
             }
-            break;
-
+            // fall through
         case BSTATE_ACQUIRED:
             if (state == BSTATE_FREE) {
                 // move it from data slot to free slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it == mDataSlot.end()) {
+                if (!inSlot(BSLOT_DATA, index)) {
                     return false;
                 }
-                mDataSlot.remove(item->mKey);
-                mFreeSlot.push_back(item->mKey);
+                removeSlot(BSLOT_DATA, index);
+                pushSlot(BSLOT_FREE, index);
                 item->mState = state;
                 return true;
             }
@@ -212,14 +396,8 @@ bool BufferQueue::toState(BufferItem* item, BufferState state) {
 }
 
 BufferItem* BufferQueue::getBuffer(BufferSlot slot) {
-    BufferKey key = -1;
-
-    if (slot == BSLOT_FREE && !mFreeSlot.empty()) {
-        key = mFreeSlot.front();
-    } else if (slot == BSLOT_DATA && !mDataSlot.empty()) {
-        key = mDataSlot.front();
-    }
-    return getBuffer(key);
+    int32_t index = mSlots[slot].mHead;
+    return index < 0 ? nullptr : &mBuffers[index];
 }
 
 } // namespace wm
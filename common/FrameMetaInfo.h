@@ -35,6 +35,12 @@ enum class FrameMetaIndex {
     RenderStart,
     FrameInterval,
     RenderEnd,
+    // the buffer has to be queued before the deadline to be shown at expected present
+    Deadline,
+    ExpectedPresent,
+    // the latest input sample shown by the frame
+    InputId,
+    InputTime,
     // End of frame meta info for UI proxy
 
     // for XMS arch
@@ -46,6 +52,8 @@ enum class FrameMetaIndex {
 enum FrameMetaInfoFlags {
     SurfaceDraw = 1 << 0,
     SkipFrame = 1 << 1,
+    // a NoBuffer skip avoided by draining all released buffers
+    BufferRecovered = 1 << 2,
 };
 
 enum class FrameMetaSkipReason {
@@ -53,6 +61,8 @@ enum class FrameMetaSkipReason {
     NoSurface,
     NothingToDraw,
     NoBuffer,
+    // would be late, left to the next vsync
+    DeadlineMissed,
 };
 
 class FrameMetaInfo {
@@ -77,6 +87,17 @@ public:
         set(FrameMetaIndex::FrameInterval) = frameIntervalMs;
     }
 
+    void setFrameTimeline(int64_t deadline, int64_t expectedPresentTime) {
+        set(FrameMetaIndex::Deadline) = deadline;
+        set(FrameMetaIndex::ExpectedPresent) = expectedPresentTime;
+    }
+
+    /* inputTime in ms */
+    void setInputEvent(int64_t inputId, int64_t inputTime) {
+        set(FrameMetaIndex::InputId) = inputId;
+        set(FrameMetaIndex::InputTime) = inputTime;
+    }
+
     const int64_t* data() const {
         return mMetaData;
     }
@@ -135,9 +156,43 @@ public:
         return duration(FrameMetaIndex::LayoutStart, FrameMetaIndex::RenderStart);
     }
 
+    /* how long the frame finished after its deadline, 0 for in time */
+    inline int64_t deadlineOverrun() const {
+        return duration(FrameMetaIndex::Deadline, FrameMetaIndex::FrameFinished);
+    }
+
+    inline bool hasDeadline() const {
+        return get(FrameMetaIndex::Deadline) > 0;
+    }
+
+    inline int64_t presentLatency() const {
+        return duration(FrameMetaIndex::Vsync, FrameMetaIndex::ExpectedPresent);
+    }
+
+    /* saved by the vsync phase lead, against composing with the next vsync */
+    inline int64_t latencyGain() const {
+        if (!hasDeadline()) return 0;
+        int64_t gain = 2 * getFrameInterval() - presentLatency();
+        return gain > 0 ? gain : 0;
+    }
+
+    inline bool hasInputEvent() const {
+        return get(FrameMetaIndex::InputId) > 0;
+    }
+
+    /* from the input sample to the frame showing it on screen */
+    inline int64_t inputLatency() const {
+        if (!hasInputEvent()) return 0;
+        return duration(FrameMetaIndex::InputTime, hasDeadline() ? FrameMetaIndex::ExpectedPresent
+                                                                  : FrameMetaIndex::FrameFinished);
+    }
+
     void addFlag(int flag) {
         set(FrameMetaIndex::Flags) |= static_cast<uint64_t>(flag);
     }
+    bool hasFlag(int flag) const {
+        return (get(FrameMetaIndex::Flags) & flag) != 0;
+    }
     void markFrameStart() {
         set(FrameMetaIndex::FrameStart) = curSysTimeMs();
     }
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameScheduler.h"
+
+namespace os {
+namespace wm {
+
+FrameScheduler::FrameScheduler() {
+    reset();
+}
+
+void FrameScheduler::reset() {
+    mHead = mCount = 0;
+    mSkipped = false;
+}
+
+void FrameScheduler::addSample(int64_t duration) {
+    if (duration < 0) return;
+
+    mSamples[mHead] = duration;
+    mHead = (mHead + 1) % FRAME_SCHEDULER_SAMPLES;
+    if (mCount < FRAME_SCHEDULER_SAMPLES) mCount++;
+}
+
+int64_t FrameScheduler::predictDuration() const {
+    if (mCount == 0) return 0;
+
+    int64_t total = 0;
+    for (uint32_t i = 0; i < mCount; i++) {
+        total += mSamples[i];
+    }
+    int64_t average = total / mCount;
+
+    /* follow a growing load at once, a single fast frame doesn't count */
+    int64_t latest = mSamples[(mHead + FRAME_SCHEDULER_SAMPLES - 1) % FRAME_SCHEDULER_SAMPLES];
+    return latest > average ? latest : average;
+}
+
+bool FrameScheduler::shouldSkip(const FrameTimeline& timeline, int64_t now) {
+    int64_t predicted = predictDuration();
+    int64_t budget = timeline.mDeadline - timeline.mVsyncTime;
+
+    /* never twice in a row, and a frame which never fits is drawn anyway */
+    if (predicted == 0 || budget <= 0 || predicted > budget || mSkipped) {
+        mSkipped = false;
+        return false;
+    }
+
+    mSkipped = now + predicted > timeline.mDeadline;
+    return mSkipped;
+}
+
+int64_t FrameScheduler::earlyStartTime(const FrameTimeline& timeline) const {
+    int64_t predicted = predictDuration();
+    int64_t budget = timeline.mDeadline - timeline.mVsyncTime;
+    int64_t period = timeline.mExpectedPresentTime - timeline.mDeadline;
+
+    if (predicted <= budget || period <= 0) {
+        return 0;
+    }
+
+    /* done right at the next deadline, but never before this frame's vsync */
+    int64_t start = timeline.mDeadline + period - predicted;
+    return start > timeline.mVsyncTime ? start : timeline.mVsyncTime;
+}
+
+} // namespace wm
+} // namespace os
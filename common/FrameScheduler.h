@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "wm/VsyncRequestOps.h"
+
+namespace os {
+namespace wm {
+
+#define FRAME_SCHEDULER_SAMPLES 8
+
+/*
+ * Predicts how long the next frame takes from the latest drawn frames, and
+ * places frames against their deadline: a frame which can't make it any more
+ * waits for the next vsync, a frame longer than its budget starts early.
+ * All times are in us.
+ */
+class FrameScheduler {
+public:
+    FrameScheduler();
+
+    void reset();
+
+    // a drawn frame, from its start to the buffer queued
+    void addSample(int64_t duration);
+    // 0 before the first sample
+    int64_t predictDuration() const;
+
+    // at a vsync, true when the frame is going to be late and the next one is in time
+    bool shouldSkip(const FrameTimeline& timeline, int64_t now);
+
+    // start time of the frame of the vsync following timeline, 0 to wait for that vsync
+    int64_t earlyStartTime(const FrameTimeline& timeline) const;
+
+private:
+    int64_t mSamples[FRAME_SCHEDULER_SAMPLES];
+    uint32_t mHead;
+    uint32_t mCount;
+    bool mSkipped;
+};
+
+} // namespace wm
+} // namespace os
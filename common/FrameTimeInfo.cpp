@@ -51,6 +51,7 @@ void FrameTimeInfo::time(FrameMetaInfo* info) {
     }
 
     mValidFrameSamples++;
+    if (info->hasFlag(FrameMetaInfoFlags::BufferRecovered)) mRecoveredFrameSamples++;
     auto curFrameTime = info->totalDuration();
     mTotalFrameTime += curFrameTime;
 
@@ -61,12 +62,34 @@ void FrameTimeInfo::time(FrameMetaInfo* info) {
         mMinFrameTime = fmin(mMinFrameTime, curFrameTime);
 
     mFrameInterval = info->getFrameInterval();
-    if (mFrameInterval > 0 && curFrameTime > mFrameInterval) mTimeoutFrameSamples++;
+    if (info->hasDeadline()) {
+        /* late for the composition it was started for */
+        if (info->deadlineOverrun() > 0) mTimeoutFrameSamples++;
+    } else if (mFrameInterval > 0 && curFrameTime > mFrameInterval) {
+        mTimeoutFrameSamples++;
+    }
+
+    if (info->hasInputEvent()) timeInput(info);
 
     mLastFrameFinishedTime = info->get(FrameMetaIndex::FrameFinished);
     logPerSecond();
 }
 
+void FrameTimeInfo::timeInput(FrameMetaInfo* info) {
+    static const int64_t bucketEdges[INPUT_LATENCY_BUCKETS - 1] = {16, 33, 50, 66, 100};
+
+    auto latency = info->inputLatency();
+    int bucket = 0;
+    while (bucket < INPUT_LATENCY_BUCKETS - 1 && latency >= bucketEdges[bucket]) {
+        bucket++;
+    }
+
+    mInputLatencyHist[bucket]++;
+    mInputSamples++;
+    mTotalInputLatency += latency;
+    if (latency > mMaxInputLatency) mMaxInputLatency = latency;
+}
+
 void FrameTimeInfo::logPerSecond(bool checksec) {
     if (mLastFrameFinishedTime == 0) return;
 
@@ -85,12 +108,21 @@ void FrameTimeInfo::logPerSecond(bool checksec) {
         FLOGW("FrameLog{ evalFPS=%.2f, frames=%" PRIu16 ":%" PRIu16 "(%" PRIu16 ":%" PRIu16
               ":%" PRIu16 "), minMs=%" PRId64 ", maxMs=%" PRId64 ", avgMs=%.2f, timeMs=%" PRId64
               "/%" PRId64 "(%" PRId64 "-%" PRId64 "), intervalMs=%" PRId64 ", skip=(%" PRIu16
-              "/%" PRIu16 ") }",
+              "/%" PRIu16 "), recovered=%" PRIu16 " }",
               fps, mValidFrameSamples, mValidFrameSamples + mSkipEmptyFrameSamples,
               mValidFrameSamples - mTimeoutFrameSamples, mTimeoutFrameSamples,
               mSkipEmptyFrameSamples, mMinFrameTime, mMaxFrameTime,
               mTotalFrameTime * 1. / mValidFrameSamples, mTotalFrameTime, interval, nowTime,
-              mLastLogFrameTime, mFrameInterval, mSkipEmptyFrameSamples, mSkipFrameSamples);
+              mLastLogFrameTime, mFrameInterval, mSkipEmptyFrameSamples, mSkipFrameSamples,
+              mRecoveredFrameSamples);
+        if (mInputSamples > 0) {
+            FLOGW("InputLatencyLog{ samples=%" PRIu16 ", avgMs=%.2f, maxMs=%" PRId64
+                  ", hist(<16:<33:<50:<66:<100:more)=%" PRIu16 ":%" PRIu16 ":%" PRIu16 ":%" PRIu16
+                  ":%" PRIu16 ":%" PRIu16 " }",
+                  mInputSamples, mTotalInputLatency * 1. / mInputSamples, mMaxInputLatency,
+                  mInputLatencyHist[0], mInputLatencyHist[1], mInputLatencyHist[2],
+                  mInputLatencyHist[3], mInputLatencyHist[4], mInputLatencyHist[5]);
+        }
         init();
     }
 }
@@ -98,9 +130,13 @@ void FrameTimeInfo::logPerSecond(bool checksec) {
 void FrameTimeInfo::init() {
     mValidFrameSamples = mTimeoutFrameSamples = 0;
     mSkipFrameSamples = mSkipEmptyFrameSamples = 0;
+    mRecoveredFrameSamples = 0;
     mFrameInterval = 0;
     mLastFrameFinishedTime = mLastLogFrameTime = 0;
     mTotalFrameTime = mMinFrameTime = mMaxFrameTime = 0;
+    mMaxInputLatency = mTotalInputLatency = 0;
+    mInputSamples = 0;
+    memset(mInputLatencyHist, 0, sizeof(mInputLatencyHist));
 }
 
 } // namespace wm
@@ -20,6 +20,9 @@
 namespace os {
 namespace wm {
 
+/* input to present latency buckets, below 16, 33, 50, 66, 100ms and above */
+#define INPUT_LATENCY_BUCKETS 6
+
 class FrameTimeInfo {
 public:
     FrameTimeInfo();
@@ -28,6 +31,7 @@ public:
 private:
     void init();
     void logPerSecond(bool checksec = true);
+    void timeInput(FrameMetaInfo *info);
 
     int64_t mMinFrameTime;
     int64_t mMaxFrameTime;
@@ -40,6 +44,12 @@ private:
     uint16_t mTimeoutFrameSamples;
     uint16_t mSkipFrameSamples;
     uint16_t mSkipEmptyFrameSamples;
+    uint16_t mRecoveredFrameSamples;
+
+    int64_t mMaxInputLatency;
+    int64_t mTotalInputLatency;
+    uint16_t mInputSamples;
+    uint16_t mInputLatencyHist[INPUT_LATENCY_BUCKETS];
 };
 
 } // namespace wm
@@ -18,7 +18,13 @@
 
 #include "wm/InputChannel.h"
 
+#include <fcntl.h>
 #include <mqueue.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+#include <sys/eventfd.h>
+#endif
 
 #include "WindowUtils.h"
 #include "wm/InputMessage.h"
@@ -26,13 +32,25 @@
 namespace os {
 namespace wm {
 
-InputChannel::InputChannel() : mEventFd(-1), mEventName("") {}
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "input ring needs lock-free atomics");
+
+enum {
+    INPUT_SLOT_IDLE = 0,
+    INPUT_SLOT_CONSUMER,
+    INPUT_SLOT_PRODUCER,
+};
+
+InputChannel::InputChannel() : mEventFd(-1), mEventName(""), mRingFd(-1), mRing(nullptr) {}
 
 InputChannel::~InputChannel() {}
 
 status_t InputChannel::writeToParcel(Parcel* out) const {
     status_t result = out->writeFileDescriptor(mEventFd);
     SAFE_PARCEL(out->writeCString, mEventName.c_str());
+    SAFE_PARCEL(out->writeBool, mRingFd != -1);
+    if (mRingFd != -1) {
+        SAFE_PARCEL(out->writeFileDescriptor, mRingFd);
+    }
 
     return result;
 }
@@ -40,11 +58,21 @@ status_t InputChannel::writeToParcel(Parcel* out) const {
 status_t InputChannel::readFromParcel(const Parcel* in) {
     mEventFd = dup(in->readFileDescriptor());
     mEventName = in->readCString();
+    if (in->readBool()) {
+        mRingFd = dup(in->readFileDescriptor());
+    }
 
     return android::OK;
 }
 
 bool InputChannel::create(const std::string& name) {
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+    if (createRing(name)) {
+        return true;
+    }
+    FLOGW("no input ring for '%s', fall back to mq", name.c_str());
+#endif
+
     const char* cname = name.c_str();
     struct mq_attr mqstat;
     int oflag = O_CREAT | O_RDWR | O_NONBLOCK | O_CLOEXEC;
@@ -63,7 +91,189 @@ bool InputChannel::create(const std::string& name) {
     return true;
 }
 
+bool InputChannel::createRing(const std::string& name) {
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+    /* channel names are mq paths, e.g. /var/run/xms:event-301-2345167890, a shm name has
+     * no slash but the leading one */
+    size_t pos = name.rfind('/');
+    std::string ringName = "/" + (pos == std::string::npos ? name : name.substr(pos + 1));
+
+    int fd = shm_open(ringName.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        FLOGE("failed to open input ring %s, %s", ringName.c_str(), strerror(errno));
+        return false;
+    }
+    /* the ring is only handed over as fd */
+    shm_unlink(ringName.c_str());
+
+    if (ftruncate(fd, sizeof(InputRing)) == -1) {
+        FLOGE("failed to resize input ring %s", ringName.c_str());
+        close(fd);
+        return false;
+    }
+
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEventFd == -1) {
+        FLOGE("failed to create input eventfd, %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    mRingFd = fd;
+    if (!mapRing()) {
+        release();
+        return false;
+    }
+    mRing->mHead.store(0, std::memory_order_relaxed);
+    mRing->mTail.store(0, std::memory_order_relaxed);
+    mRing->mMissed.store(0, std::memory_order_relaxed);
+    for (auto& owner : mRing->mOwners) {
+        owner.store(INPUT_SLOT_IDLE, std::memory_order_relaxed);
+    }
+    mEventName = name;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool InputChannel::mapRing() {
+    if (mRing) return true;
+    if (mRingFd == -1) return false;
+
+    void* ring = mmap(nullptr, sizeof(InputRing), PROT_READ | PROT_WRITE, MAP_SHARED, mRingFd, 0);
+    if (ring == MAP_FAILED) {
+        FLOGE("failed to map input ring %d", mRingFd);
+        return false;
+    }
+    mRing = static_cast<InputRing*>(ring);
+    return true;
+}
+
+int InputChannel::sendMessage(const InputMessage* msg) {
+    if (mRingFd == -1) {
+        return mq_send(mEventFd, (const char*)msg, sizeof(InputMessage), 100);
+    }
+
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+    if (!mapRing()) return -1;
+
+    uint32_t tail = mRing->mTail.load(std::memory_order_relaxed);
+    if (tail - mRing->mHead.load(std::memory_order_acquire) >= INPUT_RING_SIZE) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    mRing->mMessages[tail % INPUT_RING_SIZE] = *msg;
+    mRing->mTail.store(tail + 1, std::memory_order_seq_cst);
+
+    /*
+     * ring only when the consumer had taken everything, it looks at the tail
+     * again after moving the head, so one of both sees the other's update
+     */
+    if (mRing->mHead.load(std::memory_order_seq_cst) == tail) {
+        eventfd_write(mEventFd, 1);
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+bool InputChannel::mergeLastMessage(const InputMessage* msg) {
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+    if (mRingFd == -1 || !mapRing()) return false;
+
+    uint32_t tail = mRing->mTail.load(std::memory_order_relaxed);
+    if (tail == mRing->mHead.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    /* the consumer is reading it, queue the message instead */
+    uint32_t index = (tail - 1) % INPUT_RING_SIZE;
+    uint32_t idle = INPUT_SLOT_IDLE;
+    if (!mRing->mOwners[index].compare_exchange_strong(idle, INPUT_SLOT_PRODUCER,
+                                                       std::memory_order_seq_cst)) {
+        return false;
+    }
+
+    bool merged = mRing->mHead.load(std::memory_order_seq_cst) != tail;
+    if (merged) mRing->mMessages[index] = *msg;
+    mRing->mOwners[index].store(INPUT_SLOT_IDLE, std::memory_order_seq_cst);
+
+    /* the consumer found the slot taken and went to sleep, wake it up again */
+    if (mRing->mMissed.exchange(0, std::memory_order_seq_cst)) {
+        eventfd_write(mEventFd, 1);
+    }
+    return merged;
+#else
+    return false;
+#endif
+}
+
+bool InputChannel::popMessage(InputMessage* msg) {
+    uint32_t head = mRing->mHead.load(std::memory_order_relaxed);
+    if (mRing->mTail.load(std::memory_order_seq_cst) == head) {
+        return false;
+    }
+
+    uint32_t index = head % INPUT_RING_SIZE;
+    uint32_t idle = INPUT_SLOT_IDLE;
+    if (!mRing->mOwners[index].compare_exchange_strong(idle, INPUT_SLOT_CONSUMER,
+                                                       std::memory_order_seq_cst)) {
+        /* a newer sample is merged into it, the producer rings once it is done */
+        mRing->mMissed.store(1, std::memory_order_seq_cst);
+        idle = INPUT_SLOT_IDLE;
+        if (!mRing->mOwners[index].compare_exchange_strong(idle, INPUT_SLOT_CONSUMER,
+                                                           std::memory_order_seq_cst)) {
+            return false;
+        }
+    }
+
+    *msg = mRing->mMessages[index];
+    mRing->mHead.store(head + 1, std::memory_order_seq_cst);
+    mRing->mOwners[index].store(INPUT_SLOT_IDLE, std::memory_order_release);
+    return true;
+}
+
+bool InputChannel::receiveMessage(InputMessage* msg) {
+    if (mRingFd == -1) {
+        ssize_t size = mq_receive(mEventFd, (char*)msg, sizeof(InputMessage), NULL);
+        return size == sizeof(InputMessage);
+    }
+
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+    if (!mapRing()) return false;
+    if (popMessage(msg)) return true;
+
+    /* run dry, clear the doorbell and look once more for a message queued meanwhile */
+    eventfd_t count = 0;
+    eventfd_read(mEventFd, &count);
+    if (!popMessage(msg)) return false;
+
+    /* its doorbell may just have been cleared, keep the poll waking us up */
+    eventfd_write(mEventFd, 1);
+    return true;
+#else
+    return false;
+#endif
+}
+
 void InputChannel::release() {
+    if (mRingFd != -1) {
+        if (mRing) {
+            munmap(mRing, sizeof(InputRing));
+            mRing = nullptr;
+        }
+        close(mRingFd);
+        mRingFd = -1;
+        if (mEventFd != -1) close(mEventFd);
+        FLOGI("input ring released:%s", mEventName.c_str());
+        mEventFd = -1;
+        mEventName = "";
+        return;
+    }
+
     if (isValid()) {
         mq_close(mEventFd);
         mq_unlink(mEventName.c_str());
@@ -16,7 +16,7 @@
 
 #include "wm/LayerState.h"
 
-#include "wm/Rect.h"
+#include "wm/Region.h"
 
 namespace os {
 namespace wm {
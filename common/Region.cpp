@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wm/Region.h"
+
+namespace os {
+namespace wm {
+
+static inline int64_t rectArea(const Rect& rect) {
+    return (int64_t)(rect.right - rect.left + 1) * (rect.bottom - rect.top + 1);
+}
+
+static inline Rect rectUnion(const Rect& a, const Rect& b) {
+    return Rect(a.left < b.left ? a.left : b.left, a.top < b.top ? a.top : b.top,
+                a.right > b.right ? a.right : b.right, a.bottom > b.bottom ? a.bottom : b.bottom);
+}
+
+static inline bool rectContains(const Rect& outer, const Rect& inner) {
+    return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right &&
+            outer.bottom >= inner.bottom;
+}
+
+Rect Region::bounds() const {
+    if (mCount == 0) return Rect(0, 0, -1, -1);
+
+    Rect rect = mRects[0];
+    for (uint32_t i = 1; i < mCount; i++) {
+        rect = rectUnion(rect, mRects[i]);
+    }
+    return rect;
+}
+
+void Region::removeAt(uint32_t index) {
+    mRects[index] = mRects[--mCount];
+}
+
+Region& Region::orSelf(const Rect& rect) {
+    if (rect.right < rect.left || rect.bottom < rect.top) return *this;
+
+    Rect cur = rect;
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (uint32_t i = 0; i < mCount; i++) {
+            if (rectContains(mRects[i], cur)) return *this;
+
+            /* bounding box is not larger than the two rects drawn separately */
+            Rect box = rectUnion(mRects[i], cur);
+            if (rectArea(box) <= rectArea(mRects[i]) + rectArea(cur)) {
+                removeAt(i);
+                cur = box;
+                merged = true;
+                break;
+            }
+        }
+
+        if (!merged && mCount == REGION_MAX_RECTS) {
+            /* no free slot, merge with the rect which wastes the least area */
+            uint32_t best = 0;
+            int64_t bestCost = INT64_MAX;
+            for (uint32_t i = 0; i < mCount; i++) {
+                int64_t cost = rectArea(rectUnion(mRects[i], cur)) - rectArea(mRects[i]);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    best = i;
+                }
+            }
+            cur = rectUnion(mRects[best], cur);
+            removeAt(best);
+            merged = true;
+        }
+    }
+
+    mRects[mCount++] = cur;
+    return *this;
+}
+
+Region& Region::orSelf(const Region& region) {
+    for (const auto& rect : region) {
+        orSelf(rect);
+    }
+    return *this;
+}
+
+status_t Region::writeToParcel(Parcel* out) const {
+    SAFE_PARCEL(out->writeUint32, mCount);
+    for (uint32_t i = 0; i < mCount; i++) {
+        mRects[i].writeToParcel(out);
+    }
+    return android::OK;
+}
+
+status_t Region::readFromParcel(const Parcel* in) {
+    uint32_t count = 0;
+    SAFE_PARCEL(in->readUint32, &count);
+    if (count > REGION_MAX_RECTS) return BAD_VALUE;
+
+    mCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        Rect rect;
+        rect.readFromParcel(in);
+        orSelf(rect);
+    }
+    return android::OK;
+}
+
+} // namespace wm
+} // namespace os
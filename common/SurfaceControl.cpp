@@ -18,9 +18,12 @@
 
 #include "wm/SurfaceControl.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+
 #include "WindowUtils.h"
 
 namespace os {
@@ -146,10 +149,68 @@ void SurfaceControl::destroyFMQ() {
     mFreeMsgSlot.destroy();
 }
 
-static inline bool initSharedBuffer(std::string name, int* pfd, int32_t size) {
+void SurfaceControl::rebind(const sp<IBinder>& token, const sp<IBinder>& handle, uint32_t width,
+                            uint32_t height) {
+    mToken = token;
+    mHandle = handle;
+    mWidth = width;
+    mHeight = height;
+
+    /* all buffers go back to free, as a newly created surface */
+    if (mBufferQueue) {
+        mBufferQueue->reset();
+    }
+
+    std::vector<BufferKey> bufKeys;
+    for (const auto& id : mBufferIds) {
+        bufKeys.push_back(id.mKey);
+    }
+    mFreeMsgSlot.reset(bufKeys);
+}
+
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_MEMFD
+static inline bool initAnonymousBuffer(const std::string& name, int* pfd, int32_t size) {
+    int32_t flag = MFD_CLOEXEC;
+#ifdef MFD_ALLOW_SEALING
+    flag |= MFD_ALLOW_SEALING;
+#endif
+
+    *pfd = -1;
+    int fd = memfd_create(name.c_str(), flag);
+    if (fd == -1) {
+        FLOGE("failed to create memfd %s, %s", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (size > 0 && ftruncate(fd, size) == -1) {
+        FLOGE("failed to resize memfd for %s, size=%" PRId32 "", name.c_str(), size);
+        close(fd);
+        return false;
+    }
+
+#ifdef F_ADD_SEALS
+    /* client can never shrink the buffer under server, a lazy one is grown on first use */
+    int seals = size > 0 ? (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) : F_SEAL_SHRINK;
+    if (fcntl(fd, F_ADD_SEALS, seals) == -1) {
+        FLOGW("failed to seal memfd for %s, %s", name.c_str(), strerror(errno));
+    }
+#endif
+
+    FLOGI("init memfd success for %s, size=%" PRId32 " ", name.c_str(), size);
+    *pfd = fd;
+    return true;
+}
+#endif
+
+/* size 0 with create leaves the memory to be allocated on first use */
+static inline bool initSharedBuffer(std::string name, int* pfd, bool create, int32_t size) {
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_MEMFD
+    /* only server creates buffers, client always gets the fds by parcel */
+    if (create) return initAnonymousBuffer(name, pfd, size);
+#endif
     int32_t flag = O_RDWR | O_CLOEXEC;
 
-    if (size > 0) flag |= O_CREAT;
+    if (create) flag |= O_CREAT;
 
     *pfd = -1;
     const char* cname = name.c_str();
@@ -173,11 +234,58 @@ static inline bool initSharedBuffer(std::string name, int* pfd, int32_t size) {
     return true;
 }
 
+/* server sizes buffers at creation, or leaves it to the first dequeue */
+static inline int32_t initialBufferSize(uint32_t size) {
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    return 0;
+#else
+    return size;
+#endif
+}
+
 static inline void uninitSharedBuffer(int fd, std::string name) {
+#ifndef CONFIG_ENABLE_BUFFER_QUEUE_BY_MEMFD
     if (fd > 0) {
         int result = shm_unlink(name.c_str());
         FLOGI("uninit shared memory for %s, result=%d", name.c_str(), result);
     }
+#else
+    /* anonymous memory is freed with its last fd */
+    (void)fd;
+    (void)name;
+#endif
+}
+
+/* keep known buffers, open the added ones and drop the removed ones */
+void SurfaceControl::updateBufferIds(const std::vector<BufferId>& ids, bool isServer) {
+    std::vector<BufferId> result;
+
+    for (const auto& id : ids) {
+        auto it = std::find_if(mBufferIds.begin(), mBufferIds.end(),
+                               [&](const BufferId& cur) { return cur.mKey == id.mKey; });
+        if (it != mBufferIds.end()) {
+            if (id.mFd >= 0 && id.mFd != it->mFd) close(id.mFd);
+            result.push_back(*it);
+            continue;
+        }
+
+        int fd = id.mFd;
+        int32_t size = isServer ? initialBufferSize(mBufferSize) : 0;
+        if (fd < 0 && !initSharedBuffer(id.mName, &fd, isServer, size)) {
+            continue;
+        }
+        result.push_back({id.mName, id.mKey, fd});
+    }
+
+    if (isServer) {
+        for (const auto& cur : mBufferIds) {
+            auto it = std::find_if(result.begin(), result.end(),
+                                   [&](const BufferId& id) { return cur.mKey == id.mKey; });
+            if (it == result.end()) uninitSharedBuffer(cur.mFd, cur.mName);
+        }
+    }
+
+    mBufferIds = result;
 }
 
 /* Surface control only record bufferIds, don't control shared memory's lifecycle */
@@ -188,13 +296,13 @@ void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer)
     std::vector<BufferId> ids;
     bool result = true;
 
-    int32_t size = isServer ? sc->getBufferSize() : 0;
+    int32_t size = isServer ? initialBufferSize(sc->getBufferSize()) : 0;
 
     /* create shared memory */
     for (const auto& id : bufferIds) {
         int fd = -1;
 
-        if (!initSharedBuffer(id.mName, &fd, size)) {
+        if (!initSharedBuffer(id.mName, &fd, isServer, size)) {
             result = false;
             break;
         }
@@ -217,13 +325,16 @@ void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer)
     sc->initFMQ(isServer);
 }
 
-void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc) {
+void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer) {
     if (sc.get() == nullptr) return;
 
     FLOGI("try to uninit shared memory");
-    auto bufferIds = sc->bufferIds();
-    for (auto it : bufferIds) {
-        uninitSharedBuffer(it.mFd, it.mName);
+    /* names are owned by server, they may be reused by a parked surface */
+    if (isServer) {
+        auto bufferIds = sc->bufferIds();
+        for (auto it : bufferIds) {
+            uninitSharedBuffer(it.mFd, it.mName);
+        }
     }
     sc->clearBufferIds();
     sc->destroyFMQ();
@@ -232,7 +343,13 @@ void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc) {
 /**************** fmq ********************/
 template <typename T>
 FakeFmq<T>::FakeFmq()
-      : mName(""), mFd(0), mCaps(0), mReadPos(0), mWritePos(0), mQueue(NULL), mQueueSize(0) {}
+      : mName(""),
+        mFd(-1),
+        mCaps(0),
+        mRing(NULL),
+        mQueue(NULL),
+        mQueueSize(0),
+        mIsServer(false) {}
 
 template <typename T>
 FakeFmq<T>::~FakeFmq() {
@@ -247,8 +364,6 @@ status_t FakeFmq<T>::writeToParcel(Parcel* out) const {
     SAFE_PARCEL(out->writeDupFileDescriptor, mFd);
 #endif
     SAFE_PARCEL(out->writeUint32, mCaps);
-    SAFE_PARCEL(out->writeUint32, mReadPos);
-    SAFE_PARCEL(out->writeUint32, mWritePos);
     SAFE_PARCEL(out->writeUint32, mQueueSize);
     return android::OK;
 }
@@ -263,8 +378,6 @@ status_t FakeFmq<T>::readFromParcel(const Parcel* in) {
     mFd = dup(in->readFileDescriptor());
 #endif
     SAFE_PARCEL(in->readUint32, &mCaps);
-    SAFE_PARCEL(in->readUint32, &mReadPos);
-    SAFE_PARCEL(in->readUint32, &mWritePos);
     SAFE_PARCEL(in->readUint32, &mQueueSize);
     return android::OK;
 }
@@ -272,85 +385,114 @@ status_t FakeFmq<T>::readFromParcel(const Parcel* in) {
 template <typename T>
 void FakeFmq<T>::copyFrom(FakeFmq<T>& other) {
     mName = other.mName;
-    mFd = 0;
+    mFd = other.mFd >= 0 ? dup(other.mFd) : -1;
     mCaps = other.mCaps;
-    mReadPos = other.mReadPos;
-    mWritePos = other.mWritePos;
+    mRing = NULL;
     mQueue = NULL;
     mQueueSize = other.mQueueSize;
+    mIsServer = false;
 }
 
 template <typename T>
 void FakeFmq<T>::destroy() {
-    if (!mQueue) {
+    if (!mRing) {
+        /* fd received from parcel but never mapped */
+        if (mFd >= 0) close(mFd);
+        mFd = -1;
         return;
     }
 
     FLOGI("now unmap and close shared memory for %d, %s", mFd, mName.c_str());
-    uninitSharedBuffer(mFd, mName);
+    if (mIsServer) uninitSharedBuffer(mFd, mName);
 
-    if (munmap(mQueue, mQueueSize) == -1) {
+    if (munmap(mRing, mQueueSize) == -1) {
         FLOGE("failed to unmap shared memory fmq for %d", mFd);
     }
 
-    if (mFd > 0 && close(mFd) == -1) {
+    if (mFd >= 0 && close(mFd) == -1) {
         FLOGE("failed to close shared memory for %d", mFd);
     }
 
-    mFd = 0;
+    mFd = -1;
     mCaps = 0;
     mName = "";
-    mReadPos = 0;
-    mWritePos = 0;
+    mRing = NULL;
     mQueue = NULL;
     mQueueSize = 0;
+    mIsServer = false;
+}
+
+template <typename T>
+bool FakeFmq<T>::reset(const std::vector<T>& qData) {
+    if (!mRing || !mIsServer || qData.size() * 2 > mCaps) {
+        return false;
+    }
+
+    mRing->mWritePos.store(0, std::memory_order_relaxed);
+    mRing->mReadPos.store(0, std::memory_order_relaxed);
+    for (const auto& value : qData) {
+        write(&value);
+    }
+    return true;
 }
 
 template <typename T>
 bool FakeFmq<T>::create(const std::vector<T>& qData, bool isServer) {
-    auto bufCount = qData.size();
+    if (isServer) {
+        if (qData.empty()) {
+            FLOGW("cannot init empty fmq for %s", mName.c_str());
+            return false;
+        }
 
-    if (bufCount <= 0 && mQueue == NULL) {
-        FLOGW("cannot init empty fmq for %s", mName.c_str());
+        /* free previous dirty queue */
+        destroy();
+
+        /* keep room for every key a queue can hold twice, buffers may be added later */
+        mCaps = 4;
+        while (mCaps < DATA_MAX(qData.size(), BUFFER_QUEUE_MAX_SLOTS) * 2) {
+            mCaps <<= 1;
+        }
+        mQueueSize = sizeof(FmqRingHeader) + mCaps * sizeof(T);
+    } else if (mRing) {
+        /* shared ring is already mapped */
+        return true;
+    } else if (mCaps == 0 || (mCaps & (mCaps - 1)) != 0 ||
+               mQueueSize < sizeof(FmqRingHeader) + mCaps * sizeof(T)) {
+        FLOGW("invalid fmq for %s, caps=%" PRIu32 "", mName.c_str(), mCaps);
         return false;
     }
 
-    /* free previous dirty queue */
-    destroy();
-
-    uint32_t elmCount = qData.size() + 1;
-    auto size = elmCount * sizeof(T);
-    int fd = 0;
-    if (!initSharedBuffer(mName, &fd, isServer ? size : 0)) {
+    int fd = mFd;
+    if (fd < 0 && !initSharedBuffer(mName, &fd, isServer, isServer ? mQueueSize : 0)) {
         FLOGE("failed to init fmq for %s", mName.c_str());
         return false;
     }
 
     /* mmap */
-    void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* buffer = mmap(nullptr, mQueueSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (buffer == MAP_FAILED) {
         FLOGE("failed to map fmq for %s", mName.c_str());
-        uninitSharedBuffer(fd, mName);
+        if (isServer) uninitSharedBuffer(fd, mName);
+        close(fd);
+        mFd = -1;
         return false;
     }
 
     FLOGI("init fmq for %s", mName.c_str());
 
-    memset(buffer, 0, size);
-    mQueue = (T*)buffer;
+    mRing = static_cast<FmqRingHeader*>(buffer);
+    mQueue = reinterpret_cast<T*>(static_cast<uint8_t*>(buffer) + sizeof(FmqRingHeader));
     mFd = fd;
+    mIsServer = isServer;
 
-    int i = 0;
-    for (const auto& value : qData) {
-        mQueue[i++] = value;
+    /* only server owns the ring state, all keys are released initially */
+    if (isServer) {
+        reset(qData);
     }
-
-    mCaps = elmCount;
-    mReadPos = 0;
-    mWritePos = mCaps - 1;
-    mQueueSize = size;
     return true;
 }
 
+template class FakeFmq<BufferKey>;
+
 } // namespace wm
 } // namespace os
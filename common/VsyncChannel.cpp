@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncChannel"
+
+#include "wm/VsyncChannel.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+#include <sys/eventfd.h>
+#endif
+
+#include "WindowUtils.h"
+
+namespace os {
+namespace wm {
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "vsync page needs lock-free atomics");
+
+VsyncChannel::VsyncChannel() : mPageFd(-1), mEventFd(-1), mPage(nullptr) {}
+
+VsyncChannel::~VsyncChannel() {
+    release();
+}
+
+status_t VsyncChannel::writeToParcel(Parcel* out) const {
+    SAFE_PARCEL(out->writeDupFileDescriptor, mPageFd);
+    SAFE_PARCEL(out->writeDupFileDescriptor, mEventFd);
+    return android::OK;
+}
+
+status_t VsyncChannel::readFromParcel(const Parcel* in) {
+    release();
+    mPageFd = dup(in->readFileDescriptor());
+    mEventFd = dup(in->readFileDescriptor());
+    return android::OK;
+}
+
+bool VsyncChannel::copyFrom(const VsyncChannel& other) {
+    release();
+
+    if (other.mPageFd == -1 || other.mEventFd == -1) {
+        return false;
+    }
+    mPageFd = dup(other.mPageFd);
+    mEventFd = dup(other.mEventFd);
+    return isValid();
+}
+
+bool VsyncChannel::createPage(const std::string& name) {
+    release();
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        FLOGE("failed to open vsync page %s, %s", name.c_str(), strerror(errno));
+        return false;
+    }
+    /* clients only get this read-only fd, the writable one is closed once mapped */
+    int readFd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    /* the page is only handed over as fd */
+    shm_unlink(name.c_str());
+
+    if (readFd == -1) {
+        FLOGE("failed to reopen vsync page %s, %s", name.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(VsyncPage)) == -1) {
+        FLOGE("failed to resize vsync page %s", name.c_str());
+        close(readFd);
+        close(fd);
+        return false;
+    }
+
+    void* page = mmap(nullptr, sizeof(VsyncPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        FLOGE("failed to map vsync page %s", name.c_str());
+        close(readFd);
+        return false;
+    }
+
+    mPageFd = readFd;
+    mPage = static_cast<VsyncPage*>(page);
+    mPage->mGeneration.store(0, std::memory_order_relaxed);
+    mPage->mSeq.store(0, std::memory_order_relaxed);
+    mPage->mTimeLow.store(0, std::memory_order_relaxed);
+    mPage->mTimeHigh.store(0, std::memory_order_relaxed);
+    mPage->mDeadline.store(0, std::memory_order_relaxed);
+    mPage->mPresent.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void VsyncChannel::publish(uint32_t seq, const FrameTimeline& timeline) {
+    if (!mPage) return;
+
+    uint64_t timeUs = timeline.mVsyncTime;
+    uint32_t generation = mPage->mGeneration.load(std::memory_order_relaxed);
+    mPage->mGeneration.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    mPage->mSeq.store(seq, std::memory_order_relaxed);
+    mPage->mTimeLow.store((uint32_t)timeUs, std::memory_order_relaxed);
+    mPage->mTimeHigh.store((uint32_t)(timeUs >> 32), std::memory_order_relaxed);
+    mPage->mDeadline.store(timeline.mDeadline - timeline.mVsyncTime, std::memory_order_relaxed);
+    mPage->mPresent.store(timeline.mExpectedPresentTime - timeline.mVsyncTime,
+                          std::memory_order_relaxed);
+
+    mPage->mGeneration.store(generation + 2, std::memory_order_release);
+}
+
+bool VsyncChannel::attach(const VsyncChannel& page) {
+    release();
+
+    if (page.mPageFd == -1) {
+        return false;
+    }
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    if (mEventFd == -1) {
+        FLOGE("failed to create vsync eventfd, %s", strerror(errno));
+        return false;
+    }
+    mPageFd = dup(page.mPageFd);
+    return mPageFd != -1;
+}
+
+bool VsyncChannel::signal() {
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    return mEventFd != -1 && eventfd_write(mEventFd, 1) == 0;
+#else
+    return false;
+#endif
+}
+
+bool VsyncChannel::map() {
+    if (mPage) return true;
+    if (!isValid()) return false;
+
+    void* page = mmap(nullptr, sizeof(VsyncPage), PROT_READ, MAP_SHARED, mPageFd, 0);
+    if (page == MAP_FAILED) {
+        FLOGE("failed to map vsync page %d", mPageFd);
+        return false;
+    }
+    mPage = static_cast<VsyncPage*>(page);
+    return true;
+}
+
+bool VsyncChannel::receive(uint32_t* seq, FrameTimeline* timeline) {
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    eventfd_t count = 0;
+    if (!mPage || eventfd_read(mEventFd, &count) != 0) {
+        return false;
+    }
+#else
+    return false;
+#endif
+
+    /* vsyncs signalled before we woke up are merged into the latest one */
+    uint32_t generation, seqValue, timeLow, timeHigh, deadline, present;
+    do {
+        generation = mPage->mGeneration.load(std::memory_order_acquire);
+        seqValue = mPage->mSeq.load(std::memory_order_relaxed);
+        timeLow = mPage->mTimeLow.load(std::memory_order_relaxed);
+        timeHigh = mPage->mTimeHigh.load(std::memory_order_relaxed);
+        deadline = mPage->mDeadline.load(std::memory_order_relaxed);
+        present = mPage->mPresent.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((generation & 1) || generation != mPage->mGeneration.load(std::memory_order_relaxed));
+
+    if (seq) *seq = seqValue;
+    if (timeline) {
+        timeline->mVsyncTime = (int64_t)(((uint64_t)timeHigh << 32) | timeLow);
+        timeline->mDeadline = timeline->mVsyncTime + deadline;
+        timeline->mExpectedPresentTime = timeline->mVsyncTime + present;
+    }
+    return true;
+}
+
+void VsyncChannel::release() {
+    if (mPage) {
+        munmap(mPage, sizeof(VsyncPage));
+        mPage = nullptr;
+    }
+    if (mPageFd != -1) {
+        close(mPageFd);
+        mPageFd = -1;
+    }
+    if (mEventFd != -1) {
+        close(mEventFd);
+        mEventFd = -1;
+    }
+}
+
+} // namespace wm
+} // namespace os
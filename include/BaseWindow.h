@@ -30,6 +30,7 @@
 #include "wm/InputMessage.h"
 #include "wm/InputMonitor.h"
 #include "wm/LayoutParams.h"
+#include "wm/VsyncRequestOps.h"
 #include "wm/WindowEventListener.h"
 #include "wm/WindowFrames.h"
 namespace os {
@@ -46,6 +47,7 @@ using MOCKUI_EVENT_CALLBACK = std::function<void(void*, uint32_t, uint32_t)>;
 // end for MockUI (DummyDriver)
 
 class BufferProducer;
+class FrameScheduler;
 class UIDriverProxy;
 class WindowManager;
 class InputChannel;
@@ -63,7 +65,8 @@ public:
         Status moved(int32_t newX, int32_t newY) override;
         Status resized(const WindowFrames& frames, int32_t displayId) override;
         Status dispatchAppVisibility(bool visible) override;
-        Status onFrame(int32_t seq) override;
+        Status onFrame(int32_t seq, int64_t vsyncTime, int64_t expectedPresentTime,
+                       int64_t deadline) override;
         Status bufferReleased(int32_t bufKey) override;
 
         void clear();
@@ -76,6 +79,11 @@ public:
     ~BaseWindow();
 
     bool scheduleVsync(VsyncRequest freq);
+    // frame rate of periodic requests in Hz, divided from the display rate, 0 for full rate
+    void setFrameRate(uint32_t frameRate);
+    // frame of the process vsync channel, taken when a tick of the requested rate
+    // passed since the last channel vsync
+    void dispatchVsync(int32_t seq, const FrameTimeline& timeline);
 
     sp<IWindow> getIWindow() {
         return mIWindow;
@@ -118,13 +126,26 @@ public:
     void traceFrame(bool enable);
 
 private:
-    void onFrame(int32_t seq);
+    void onFrame(int32_t seq, const FrameTimeline& timeline);
+    void renderFrame(int32_t seq, const FrameTimeline& timeline, bool early);
+    void drawFrame(int32_t seq, const FrameTimeline& timeline, bool early);
+    void scheduleEarlyFrame(int32_t seq, const FrameTimeline& timeline);
+    void onEarlyFrame();
     void bufferReleased(int32_t bufKey);
 
     std::shared_ptr<BufferProducer> getBufferProducer();
     void updateOrCreateBufferQueue();
-    void handleOnFrame(int32_t seq);
+    bool handleOnFrame(int32_t seq);
     void clearSurfaceBuffer();
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+    void updateBufferCount(uint32_t count);
+    void restartBufferIdleTimer();
+    void onBufferIdle();
+#endif
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    void schedulePrefault();
+    void onPrefault();
+#endif
 
     ::os::app::Context* mContext;
     WindowManager* mWindowManager;
@@ -135,11 +156,28 @@ private:
     std::shared_ptr<InputMonitor> mInputMonitor;
     std::shared_ptr<UIDriverProxy> mUIProxy;
     VsyncRequest mVsyncRequest;
+    VsyncRequest mPeriodicRequest;
     bool mAppVisible;
     atomic_bool mFrameDone;
     bool mSurfaceBufferReady;
     bool mTraceFrame;
     void* mFrameTimeInfo;
+    FrameScheduler* mFrameScheduler;
+    /* the frame of the next vsync, started before it when frames run long */
+    uv_timer_t* mEarlyFrameTimer;
+    FrameTimeline mEarlyTimeline;
+    int32_t mEarlySeq;
+    int64_t mEarlyFrameTime;
+    /* tick of the last vsync received from the channel */
+    uint32_t mLastVsyncSeq;
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+    uint32_t mBufferStalls;
+    uv_timer_t* mBufferIdleTimer;
+#endif
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+    /* maps the next buffer after the frame, out of the frame time */
+    uv_idle_t* mPrefaultIdle;
+#endif
 };
 
 } // namespace wm
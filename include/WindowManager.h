@@ -24,6 +24,7 @@
 #include "app/Context.h"
 #include "os/wm/BnWindowManager.h"
 #include "wm/InputMonitor.h"
+#include "wm/VsyncChannel.h"
 
 namespace os {
 namespace wm {
@@ -61,17 +62,33 @@ public:
         if (height) *height = mDispHeight;
     }
 
+    /* LVGL timers run once per vsync tick at its time, the event timer is the fallback */
+    void runFrameTimers(int64_t vsyncTime);
+
     static std::shared_ptr<InputMonitor> monitorInput(const ::std::string& name, int32_t displayId);
     static void releaseInput(InputMonitor* monitor);
 
 private:
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    void startVsyncChannel(uv_loop_t* loop);
+    void stopVsyncChannel();
+    void dispatchVsync();
+#endif
+
     std::mutex mLock;
     vector<std::shared_ptr<BaseWindow>> mWindows;
     sp<IWindowManager> mService;
     std::shared_ptr<SurfaceTransaction> mTransaction;
     uv_timer_t mEventTimer;
     bool mTimerInited;
+    uint32_t mTimerSleep;
+    int64_t mTimerVsyncTime;
     uint32_t mDispWidth, mDispHeight;
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    sp<IBinder> mVsyncToken;
+    VsyncChannel mVsyncChannel;
+    uv_poll_t* mVsyncPoll;
+#endif
 };
 
 } // namespace wm
@@ -17,15 +17,18 @@
 #pragma once
 #include <nuttx/config.h>
 
-#include <list>
 #include <memory>
 #include <string>
-#include <unordered_map>
 
 namespace os {
 namespace wm {
 
 class SurfaceControl;
+template <typename T>
+class FakeFmq;
+
+// upper bound of buffers in one queue, slots are preallocated inline
+#define BUFFER_QUEUE_MAX_SLOTS 8
 
 typedef enum {
     BSTATE_FREE = 0,
@@ -48,6 +51,8 @@ typedef struct {
     uint32_t mSize;
     BufferState mState;
     void* mUserData;
+    // frames queued since this buffer was drawn, 1 for the latest one, 0 if undefined
+    uint32_t mAge;
 } BufferItem;
 
 typedef enum {
@@ -62,21 +67,75 @@ public:
 
     bool update(const std::shared_ptr<SurfaceControl>& sc);
     bool cancelBuffer(BufferItem* item);
+    // keep the mappings, return every buffer to free
+    void reset();
+    // key of the next free buffer or -1
+    BufferKey getFreeKey();
+
+    uint32_t getBufferCount() {
+        return mBufferCount;
+    }
+
+    BufferItem* getBufferByKey(BufferKey key) {
+        return getBuffer(key);
+    }
 
 protected:
     BufferItem* getBuffer(BufferSlot slot);
     BufferItem* syncState(BufferKey key, BufferState state);
     bool toState(BufferItem* item, BufferState state);
+    void updateAge(BufferItem* drawn);
+    // removed from surface while in use, it goes once it is free again
+    bool isRemoved(const BufferItem* item) const {
+        int32_t index = slotIndex(item);
+        return index >= 0 && (mRemovedSlots & (1u << index)) != 0;
+    }
+
+    // buffers are mapped on first use, prefault asks for the pages at once
+    bool materialize(BufferItem* item, bool prefault);
+    BufferItem* getUnmappedBuffer();
 
 private:
+    // FIFO of slot indexes, the links are kept in mSlotLinks so that
+    // push/remove are O(1) and never touch the heap
+    typedef struct {
+        int8_t mHead;
+        int8_t mTail;
+    } SlotFifo;
+
+    typedef struct {
+        int8_t mPrev;
+        int8_t mNext;
+        int8_t mOwner; // -1 or BufferSlot which holds this slot
+    } SlotLink;
+
     BufferItem* getBuffer(BufferKey bufKey);
     void clearBuffers();
+    bool addBuffer(const BufferId& id, uint32_t size);
+    void removeBuffer(int32_t index);
+    bool syncBuffers(const std::shared_ptr<SurfaceControl>& sc);
+
+    bool isUsed(int32_t index) const {
+        return (mUsedSlots & (1u << index)) != 0;
+    }
+
+    int32_t slotIndex(const BufferItem* item) const;
+    bool moveState(BufferItem* item, BufferState state);
+    bool inSlot(BufferSlot slot, int32_t index) const {
+        return mSlotLinks[index].mOwner == slot;
+    }
+    void pushSlot(BufferSlot slot, int32_t index);
+    void removeSlot(BufferSlot slot, int32_t index);
+    void resetSlots();
 
     std::weak_ptr<SurfaceControl> mSurfaceControl;
-    std::unordered_map<BufferKey, BufferItem> mBuffers;
 
-    std::list<BufferKey> mDataSlot;
-    std::list<BufferKey> mFreeSlot;
+    BufferItem mBuffers[BUFFER_QUEUE_MAX_SLOTS];
+    SlotLink mSlotLinks[BUFFER_QUEUE_MAX_SLOTS];
+    SlotFifo mSlots[BSLOT_DATA + 1];
+    uint32_t mUsedSlots;
+    uint32_t mRemovedSlots;
+    uint32_t mBufferCount;
 
     uint32_t mWidth;
     uint32_t mHeight;
@@ -94,6 +153,20 @@ public:
     BufferItem* syncFreeState(BufferKey key) {
         return syncState(key, BSTATE_FREE);
     }
+
+    // drain every released key, recovered is set when only the keys behind
+    // the first one made a buffer available for dequeue
+    uint32_t syncFreeState(FakeFmq<BufferKey>& fmq, bool* recovered);
+
+    bool hasFreeBuffer() {
+        return getBuffer(BSLOT_FREE) != nullptr;
+    }
+
+    // map the next free buffer which was never used, out of the frame path
+    bool prefaultBuffer() {
+        BufferItem* item = getUnmappedBuffer();
+        return item != nullptr && materialize(item, true);
+    }
 };
 
 class BufferConsumer : public BufferQueue {
@@ -104,9 +177,7 @@ public:
     BufferItem* acquireBuffer();
     bool releaseBuffer(BufferItem* buffer);
 
-    BufferItem* syncQueuedState(BufferKey key) {
-        return syncState(key, BSTATE_QUEUED);
-    }
+    BufferItem* syncQueuedState(BufferKey key);
 };
 
 } // namespace wm
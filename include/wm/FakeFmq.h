@@ -23,6 +23,10 @@
 #include <binder/Status.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 namespace os {
 namespace wm {
 
@@ -32,6 +36,20 @@ using android::Parcelable;
 using android::sp;
 using android::status_t;
 
+#define FMQ_CACHELINE_SIZE 64
+
+/*
+ * Single producer single consumer ring living in shared memory, the server
+ * writes and the client reads. Positions are free running counters, the
+ * capacity is a power of two, so full and empty are never ambiguous.
+ */
+typedef struct {
+    alignas(FMQ_CACHELINE_SIZE) std::atomic<uint32_t> mWritePos;
+    alignas(FMQ_CACHELINE_SIZE) std::atomic<uint32_t> mReadPos;
+} FmqRingHeader;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "fmq needs lock-free atomics");
+
 template <typename T>
 class FakeFmq {
 public:
@@ -39,38 +57,77 @@ public:
     ~FakeFmq();
 
     bool read(T* data) {
-        if (!mQueue || mCaps <= 0 || !data) {
+        if (!mRing || !data) {
             return false;
         }
 
-        auto current = mQueue[mReadPos];
-
-        /* no valid item */
-        if (current == 0) {
+        uint32_t readPos = mRing->mReadPos.load(std::memory_order_relaxed);
+        if (readPos == mRing->mWritePos.load(std::memory_order_acquire)) {
             return false;
         }
 
-        *data = current;
-        mReadPos = (mReadPos + 1) % mCaps;
+        *data = mQueue[readPos & (mCaps - 1)];
+        mRing->mReadPos.store(readPos + 1, std::memory_order_release);
         return true;
     }
 
+    // read up to count items with a single index update
+    uint32_t readBatch(T* data, uint32_t count) {
+        if (!mRing || !data) {
+            return 0;
+        }
+
+        uint32_t readPos = mRing->mReadPos.load(std::memory_order_relaxed);
+        uint32_t avail = mRing->mWritePos.load(std::memory_order_acquire) - readPos;
+        if (count > avail) {
+            count = avail;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            data[i] = mQueue[(readPos + i) & (mCaps - 1)];
+        }
+        if (count > 0) {
+            mRing->mReadPos.store(readPos + count, std::memory_order_release);
+        }
+        return count;
+    }
+
     bool write(const T* data) {
-        if (!mQueue || mCaps <= 0 || !data) {
+        if (!mRing || !data) {
             return false;
         }
 
-        /*firstly write ending flag */
-        auto next = (mWritePos + 1) % mCaps;
-        mQueue[next] = 0;
+        uint32_t writePos = mRing->mWritePos.load(std::memory_order_relaxed);
+        if (writePos - mRing->mReadPos.load(std::memory_order_acquire) >= mCaps) {
+            return false;
+        }
 
-        mQueue[mWritePos] = *data;
-        mWritePos = next;
+        mQueue[writePos & (mCaps - 1)] = *data;
+        mRing->mWritePos.store(writePos + 1, std::memory_order_release);
         return true;
     }
 
+    bool empty() const {
+        return !mRing ||
+                mRing->mReadPos.load(std::memory_order_acquire) ==
+                        mRing->mWritePos.load(std::memory_order_acquire);
+    }
+
+    bool full() const {
+        return mRing &&
+                mRing->mWritePos.load(std::memory_order_acquire) -
+                                mRing->mReadPos.load(std::memory_order_acquire) >=
+                        mCaps;
+    }
+
+    uint32_t capacity() const {
+        return mCaps;
+    }
+
     bool create(const std::vector<T>& qData, bool isServer);
     void destroy();
+    // server only, empty the ring and release all keys again
+    bool reset(const std::vector<T>& qData);
 
     void setName(const std::string& name) {
         mName = name;
@@ -87,11 +144,10 @@ private:
     std::string mName;
     int mFd;
     uint32_t mCaps;
-    uint32_t mReadPos;
-    uint32_t mWritePos;
-    uint32_t mReserved;
+    FmqRingHeader* mRing;
     T* mQueue;
     uint32_t mQueueSize;
+    bool mIsServer;
 };
 
 } // namespace wm
@@ -22,6 +22,12 @@
 #include <binder/Status.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+
+#include "wm/InputMessage.h"
+
+#define INPUT_RING_SIZE 64
+
 namespace os {
 namespace wm {
 
@@ -30,6 +36,26 @@ using namespace android::base;
 using namespace android::binder;
 using namespace std;
 
+/*
+ * Ring of input messages shared by one dispatcher and one monitor. The
+ * producer only rings the eventfd when it fills an empty ring, the consumer
+ * drains the ring and clears the doorbell once it has run dry. A slot is
+ * owned by one side while it is read or rewritten, so the producer can merge
+ * a newer sample into the last message still queued.
+ */
+typedef struct {
+    std::atomic<uint32_t> mHead;
+    std::atomic<uint32_t> mTail;
+    std::atomic<uint32_t> mMissed;
+    std::atomic<uint32_t> mOwners[INPUT_RING_SIZE];
+    InputMessage mMessages[INPUT_RING_SIZE];
+} InputRing;
+
+/*
+ * Input events from the service to a window or monitor, by a shared ring
+ * with an eventfd doorbell, or by a message queue when the ring isn't
+ * available. The event fd is the one to poll in both cases.
+ */
 class InputChannel : public Parcelable {
 public:
     InputChannel();
@@ -47,20 +73,38 @@ public:
     void copyFrom(InputChannel& other) {
         mEventFd = other.mEventFd;
         mEventName = other.mEventName;
+        mRingFd = other.mRingFd;
     }
 
     bool isValid() {
         return mEventFd != -1 ? true : false;
     }
+    // messages go through the shared ring instead of the message queue
+    bool isRing() {
+        return mRingFd != -1;
+    }
 
     bool create(const std::string& name);
     void release();
 
+    // service, -1 when the other side doesn't keep up
+    int sendMessage(const InputMessage* msg);
+    // service, replace the last message if it hasn't been taken yet
+    bool mergeLastMessage(const InputMessage* msg);
+    // client
+    bool receiveMessage(InputMessage* msg);
+
     DISALLOW_COPY_AND_ASSIGN(InputChannel);
 
 private:
+    bool createRing(const std::string& name);
+    bool mapRing();
+    bool popMessage(InputMessage* msg);
+
     int mEventFd;
     std::string mEventName;
+    int mRingFd;
+    InputRing* mRing;
 };
 
 } // namespace wm
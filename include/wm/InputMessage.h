@@ -27,7 +27,8 @@ namespace wm {
 static inline void dumpInputMessage(const InputMessage* ie) {
     if (!ie) return;
 
-    ALOGD("Message: type(%d), state(%d)", ie->type, ie->state);
+    ALOGD("Message: type(%d), state(%d), seq(%" PRIu32 "), time(%" PRIu64 ")", ie->type, ie->state,
+          ie->seq, ie->timestamp);
     if (ie->type == INPUT_MESSAGE_TYPE_POINTER) {
         ALOGD("\t\traw pos(%" PRId32 ", %" PRId32 "), pos(%" PRId32 ", %" PRId32
               "), gesture(%" PRIu8 ")",
@@ -39,4 +39,7 @@ typedef struct {
             uint8_t gesture_state;
         } pointer;
     };
+    /* id and monotonic time in us of the device sample, stamped by the service */
+    uint32_t seq;
+    uint64_t timestamp;
 } InputMessage;
@@ -22,7 +22,7 @@
 #include <utils/RefBase.h>
 
 #include "wm/BufferQueue.h"
-#include "wm/Rect.h"
+#include "wm/Region.h"
 
 namespace os {
 namespace wm {
@@ -58,7 +58,7 @@ public:
     int32_t mY;
     int32_t mAlpha;
     BufferKey mBufferKey;
-    Rect mBufferCrop;
+    Region mBufferCrop;
     int32_t mFlags;
     sp<IBinder> mToken;
     uint32_t mSeq;
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "wm/Rect.h"
+
+namespace os {
+namespace wm {
+
+// upper bound of rects in one region, extra rects are merged into the closest one
+#define REGION_MAX_RECTS 4
+
+/* A small set of inclusive rects (as lv_area_t) describing damaged areas */
+class Region {
+public:
+    Region() : mCount(0) {}
+    Region(const Rect& rect) : mCount(0) {
+        orSelf(rect);
+    }
+
+    void clear() {
+        mCount = 0;
+    }
+
+    bool isEmpty() const {
+        return mCount == 0;
+    }
+
+    uint32_t size() const {
+        return mCount;
+    }
+
+    const Rect* begin() const {
+        return mRects;
+    }
+
+    const Rect* end() const {
+        return mRects + mCount;
+    }
+
+    const Rect& operator[](uint32_t index) const {
+        return mRects[index];
+    }
+
+    Rect bounds() const;
+
+    // add a rect, it is merged with the others when the bounding box costs less
+    // than keeping both, or when the region is full
+    Region& orSelf(const Rect& rect);
+    Region& orSelf(const Region& region);
+
+    status_t writeToParcel(Parcel* out) const;
+    status_t readFromParcel(const Parcel* in);
+
+private:
+    void removeAt(uint32_t index);
+
+    Rect mRects[REGION_MAX_RECTS];
+    uint32_t mCount;
+};
+
+} // namespace wm
+} // namespace os
@@ -57,6 +57,7 @@ public:
     }
 
     void initBufferIds(const std::vector<BufferId>& ids);
+    void updateBufferIds(const std::vector<BufferId>& ids, bool isServer);
     void clearBufferIds() {
         mBufferIds.clear();
     }
@@ -101,6 +102,10 @@ public:
     bool initFMQ(bool isServer);
     void destroyFMQ();
 
+    // server only, hand the existing buffers and fmq to a new surface handle
+    void rebind(const sp<IBinder>& token, const sp<IBinder>& handle, uint32_t width,
+                uint32_t height);
+
     SurfaceFreeInfoClass& getFMQ() {
         return mFreeMsgSlot;
     }
@@ -125,7 +130,7 @@ private:
 };
 
 void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer);
-void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc);
+void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer);
 
 } // namespace wm
 } // namespace os
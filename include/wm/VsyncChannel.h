@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <binder/Parcel.h>
+#include <binder/Parcelable.h>
+#include <binder/Status.h>
+#include <utils/RefBase.h>
+
+#include <atomic>
+#include <string>
+
+#include "wm/VsyncRequestOps.h"
+
+namespace os {
+namespace wm {
+
+using android::Parcel;
+using android::Parcelable;
+using android::status_t;
+
+/*
+ * Vsync page shared by the service with all subscribed processes, only the
+ * service writes it. Fields are guarded by mGeneration as a seqlock, it is
+ * odd while an update is in progress. The timestamp is split in two words
+ * because 64-bit atomics are not lock-free on every target, deadline and
+ * expected present are kept as offsets from it.
+ */
+typedef struct {
+    std::atomic<uint32_t> mGeneration;
+    std::atomic<uint32_t> mSeq;
+    std::atomic<uint32_t> mTimeLow;
+    std::atomic<uint32_t> mTimeHigh;
+    std::atomic<uint32_t> mDeadline;
+    std::atomic<uint32_t> mPresent;
+} VsyncPage;
+
+/*
+ * One channel per process: the shared vsync page and an eventfd, which is
+ * signalled once per vsync when any window of the process wants a frame.
+ */
+class VsyncChannel : public Parcelable {
+public:
+    VsyncChannel();
+    ~VsyncChannel();
+
+    status_t writeToParcel(Parcel* out) const override;
+    status_t readFromParcel(const Parcel* in) override;
+
+    // duplicate the fds, both channels own their copies
+    bool copyFrom(const VsyncChannel& other);
+
+    bool isValid() {
+        return mPageFd != -1 && mEventFd != -1;
+    }
+
+    int getEventFd() {
+        return mEventFd;
+    }
+
+    // read-only, only the owner maps the page writable
+    int getPageFd() {
+        return mPageFd;
+    }
+
+    // service, the page owner
+    bool createPage(const std::string& name);
+    void publish(uint32_t seq, const FrameTimeline& timeline);
+
+    // service, a channel of a subscribed process sharing the page
+    bool attach(const VsyncChannel& page);
+    bool signal();
+
+    // client
+    bool map();
+    bool receive(uint32_t* seq, FrameTimeline* timeline);
+
+    void release();
+
+    DISALLOW_COPY_AND_ASSIGN(VsyncChannel);
+
+private:
+    int mPageFd;
+    int mEventFd;
+    VsyncPage* mPage;
+};
+
+} // namespace wm
+} // namespace os
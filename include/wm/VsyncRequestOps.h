@@ -16,11 +16,91 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "os/wm/VsyncRequest.h"
 
+/* slowest periodic rate, every 16th vsync tick */
+#define VSYNC_MAX_DIVISOR 16
+
 namespace os {
 namespace wm {
 
+/*
+ * Timeline of the frame started by one vsync, in us on CLOCK_MONOTONIC. The
+ * buffer queued before the deadline is picked up by the next composition and
+ * shown one period after that. Without a phase lead the composition runs
+ * together with the next vsync, with a lead it runs that long after this one.
+ */
+typedef struct {
+    int64_t mVsyncTime;
+    int64_t mDeadline;
+    int64_t mExpectedPresentTime;
+} FrameTimeline;
+
+static inline FrameTimeline makeFrameTimeline(int64_t vsyncTime, int64_t periodUs,
+                                              int64_t leadUs) {
+    FrameTimeline timeline;
+    timeline.mVsyncTime = vsyncTime;
+    timeline.mDeadline = vsyncTime + (leadUs > 0 ? leadUs : periodUs);
+    timeline.mExpectedPresentTime = timeline.mDeadline + periodUs;
+    return timeline;
+}
+
+/*
+ * Periodic requests above VSYNC_REQ_PERIODIC are rate divisors, they wake up
+ * on every Nth vsync tick, e.g. 2 for 30Hz on a 60Hz display.
+ */
+static inline bool isPeriodicVsync(VsyncRequest req) {
+    return req >= VsyncRequest::VSYNC_REQ_PERIODIC;
+}
+
+/* requests come from clients, larger divisors would stretch the shared vsync timer */
+static inline bool isValidVsync(VsyncRequest req) {
+    return req >= VsyncRequest::VSYNC_REQ_NONE &&
+            static_cast<int32_t>(req) <= VSYNC_MAX_DIVISOR;
+}
+
+static inline uint32_t vsyncDivisor(VsyncRequest req) {
+    return isPeriodicVsync(req) ? static_cast<uint32_t>(req) : 1;
+}
+
+static inline VsyncRequest periodicVsync(uint32_t divisor) {
+    if (divisor > VSYNC_MAX_DIVISOR) divisor = VSYNC_MAX_DIVISOR;
+    return divisor > 1 ? static_cast<VsyncRequest>(divisor) : VsyncRequest::VSYNC_REQ_PERIODIC;
+}
+
+/* the divisor closest to frameRate, 0 keeps the refresh rate */
+static inline VsyncRequest periodicVsyncForRate(uint32_t refreshRate, uint32_t frameRate) {
+    if (frameRate == 0 || frameRate >= refreshRate) {
+        return VsyncRequest::VSYNC_REQ_PERIODIC;
+    }
+    return periodicVsync((refreshRate + frameRate / 2) / frameRate);
+}
+
+/* ticks are counted by the service, single requests take every tick */
+static inline bool vsyncDueAt(VsyncRequest req, uint32_t tick) {
+    if (req == VsyncRequest::VSYNC_REQ_NONE) return false;
+    return tick % vsyncDivisor(req) == 0;
+}
+
+/* a tick of the rate passed after lastTick up to tick, merged wakeups skip ticks */
+static inline bool vsyncDueSince(VsyncRequest req, uint32_t lastTick, uint32_t tick) {
+    if (req == VsyncRequest::VSYNC_REQ_NONE) return false;
+    uint32_t elapsed = tick - lastTick;
+    uint32_t divisor = vsyncDivisor(req);
+    return elapsed >= divisor || tick % divisor < elapsed;
+}
+
+static inline uint32_t vsyncGcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
 static inline VsyncRequest nextVsyncState(VsyncRequest req) {
     switch (req) {
         case VsyncRequest::VSYNC_REQ_NONE:
@@ -39,7 +119,7 @@ static inline VsyncRequest nextVsyncState(VsyncRequest req) {
             break;
     }
 
-    return VsyncRequest::VSYNC_REQ_NONE;
+    return isPeriodicVsync(req) ? req : VsyncRequest::VSYNC_REQ_NONE;
 }
 
 static inline const char* VsyncRequestToString(VsyncRequest req) {
@@ -60,7 +140,7 @@ static inline const char* VsyncRequestToString(VsyncRequest req) {
             break;
     }
 
-    return "unknown";
+    return isPeriodicVsync(req) ? "periodic-divided" : "unknown";
 }
 
 } // namespace wm
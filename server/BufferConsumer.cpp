@@ -24,6 +24,17 @@ namespace wm {
 BufferConsumer::BufferConsumer(const std::shared_ptr<SurfaceControl>& sc) : BufferQueue(sc) {}
 BufferConsumer::~BufferConsumer() {}
 
+BufferItem* BufferConsumer::syncQueuedState(BufferKey key) {
+    BufferItem* bufferItem = syncState(key, BSTATE_QUEUED);
+    if (bufferItem == nullptr || materialize(bufferItem, false)) {
+        return bufferItem;
+    }
+
+    /* cannot read it, give it back */
+    toState(bufferItem, BSTATE_FREE);
+    return nullptr;
+}
+
 BufferItem* BufferConsumer::acquireBuffer() {
     BufferItem* bufferItem = getBuffer(BSLOT_DATA);
     if (bufferItem != nullptr && toState(bufferItem, BSTATE_ACQUIRED)) {
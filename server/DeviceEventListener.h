@@ -25,6 +25,9 @@ class DeviceEventListener {
 public:
     virtual bool responseVsync() = 0;
     virtual bool responseInput(InputMessage* msg) = 0;
+    virtual bool responseFrameStart() = 0;
+    /* whether the display may stop refreshing, nothing left to compose */
+    virtual bool responseIdle() = 0;
 };
 
 } // namespace wm
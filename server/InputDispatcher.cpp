@@ -18,8 +18,6 @@
 
 #include "InputDispatcher.h"
 
-#include <mqueue.h>
-
 #include "../common/WindowUtils.h"
 #include "wm/InputMessage.h"
 
@@ -28,6 +26,14 @@ namespace wm {
 
 InputDispatcher::InputDispatcher() {
     mErrCount = 0;
+    memset(&mLastMessage, 0, sizeof(mLastMessage));
+    mLastMove = false;
+}
+
+static inline bool isPointerMove(const InputMessage* last, const InputMessage* ie) {
+    return ie->type == INPUT_MESSAGE_TYPE_POINTER && last->type == INPUT_MESSAGE_TYPE_POINTER &&
+            ie->state == last->state &&
+            ie->pointer.gesture_state == last->pointer.gesture_state;
 }
 
 InputDispatcher::~InputDispatcher() {
@@ -55,7 +61,16 @@ int InputDispatcher::sendMessage(const InputMessage* ie) {
         return -1;
     }
 
-    int ret = mq_send(fd, (const char*)ie, sizeof(InputMessage), 100);
+    bool move = isPointerMove(&mLastMessage, ie);
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_COALESCE
+    /* only the latest position matters, press and release edges are never merged */
+    if (move && mLastMove && mInputChannel.mergeLastMessage(ie)) {
+        mLastMessage = *ie;
+        return 0;
+    }
+#endif
+
+    int ret = mInputChannel.sendMessage(ie);
 
     if (ret < 0) {
         mErrCount++;
@@ -67,6 +82,8 @@ int InputDispatcher::sendMessage(const InputMessage* ie) {
     }
 
     mErrCount = 0;
+    mLastMessage = *ie;
+    mLastMove = move;
     return 0;
 }
 
@@ -47,6 +47,9 @@ public:
 private:
     InputChannel mInputChannel;
     int mErrCount;
+    /* the last message queued, and whether it was a move, not an edge */
+    InputMessage mLastMessage;
+    bool mLastMove;
 };
 
 } // namespace wm
@@ -18,13 +18,20 @@
 
 #include "RootContainer.h"
 
+#include <kvdb.h>
 #include <lvgl/lvgl.h>
+#include <lvgl/src/lvgl_private.h>
 
 #include "../common/WindowUtils.h"
 #include "WindowManagerService.h"
+#include "wm/VsyncRequestOps.h"
 
 namespace os {
 namespace wm {
+
+#define VSYNC_APP_OFFSET_KVDB_KEY "persist.wm.vsync.app_offset"
+#define VSYNC_COMPOSE_OFFSET_KVDB_KEY "persist.wm.vsync.compose_offset"
+
 #ifdef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
 static void vsyncEventReceived(lv_event_t* e);
 #endif
@@ -33,12 +40,20 @@ RootContainer::RootContainer(DeviceEventListener* listener, uv_loop_t* loop)
       : mListener(listener),
         mDisp(nullptr),
         mVsyncEnabled(false),
+        mVsyncDivisor(1),
+        mVsyncLead(0),
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
         mVsyncTimer(nullptr),
 #endif
         mUvData(nullptr),
         mUvLoop(loop),
-        mTraceFrame(false) {
+        mTraceFrame(false),
+        mState(CONTAINER_STATE_ACTIVE),
+        mFrameStartTime(0),
+        mFrameOverrun(false),
+        mInputPressed(false),
+        mInputSeq(0),
+        mInputTime(0) {
     mReady = init();
     if (mReady) {
         // set bg color to black for lvgl
@@ -135,6 +150,10 @@ void RootContainer::enableVsync(bool enable) {
 
     FLOGI("%s fb vsync event", enable ? "enable" : "disable");
     mVsyncEnabled = enable;
+    if (enable) {
+        updateVsyncPhase();
+        wakeUp();
+    }
 #ifdef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
 #if 0
     lv_timer_t* timer = lv_timer_create(asyncEnableVsync, 0, this);
@@ -162,8 +181,90 @@ void RootContainer::enableVsync(bool enable) {
     WM_PROFILER_END();
 }
 
+void RootContainer::setVsyncDivisor(uint32_t divisor) {
+#ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
+    /* vsync events come from the display at its own rate */
+    if (divisor == 0 || divisor == mVsyncDivisor || !mVsyncTimer) {
+        return;
+    }
+    if (divisor > VSYNC_MAX_DIVISOR) divisor = VSYNC_MAX_DIVISOR;
+
+    FLOGD("vsync timer divisor from %" PRIu32 " to %" PRIu32, mVsyncDivisor, divisor);
+    mVsyncDivisor = divisor;
+    lv_timer_set_period(mVsyncTimer, LV_DEF_REFR_PERIOD * divisor);
+#endif
+}
+
+void RootContainer::updateVsyncPhase() {
+#ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
+    /* offsets from the refresh in ms, tunable at runtime for the next vsync run */
+    int32_t appOffset =
+            property_get_int32(VSYNC_APP_OFFSET_KVDB_KEY, CONFIG_WINDOW_VSYNC_APP_OFFSET);
+    int32_t composeOffset =
+            property_get_int32(VSYNC_COMPOSE_OFFSET_KVDB_KEY, CONFIG_WINDOW_VSYNC_COMPOSE_OFFSET);
+    int32_t lead = composeOffset - appOffset;
+
+    /* the composition has to follow the apps within the same period */
+    mVsyncLead = (lead > 0 && lead < LV_DEF_REFR_PERIOD) ? lead : 0;
+    FLOGD("vsync phase app=%" PRId32 " compose=%" PRId32 " lead=%" PRIu32, appOffset,
+          composeOffset, mVsyncLead);
+#endif
+}
+
+void RootContainer::scheduleRefresh() {
+    wakeUp();
+    lv_timer_t* refrTimer = lv_display_get_refr_timer(mDisp);
+    if (refrTimer && refrTimer->paused) lv_timer_resume(refrTimer);
+}
+
+void RootContainer::wakeUp() {
+    if (mState == CONTAINER_STATE_ACTIVE) return;
+
+    FLOGD("leave idle");
+    mState = CONTAINER_STATE_ACTIVE;
+    lv_timer_t* refrTimer = lv_display_get_refr_timer(mDisp);
+    if (refrTimer && refrTimer->paused) lv_timer_resume(refrTimer);
+    pauseInputPolling(false);
+}
+
+void RootContainer::updateIdleState() {
+    if (mState == CONTAINER_STATE_IDLE || mVsyncEnabled || mInputPressed) return;
+
+    /* areas invalidated during this refresh, or animations still running */
+    if (mDisp->inv_p > 0 || !lv_anim_get_timer()->paused) return;
+    if (mListener && !mListener->responseIdle()) return;
+
+    FLOGD("enter idle");
+    mState = CONTAINER_STATE_IDLE;
+    lv_timer_t* refrTimer = lv_display_get_refr_timer(mDisp);
+    if (refrTimer && !refrTimer->paused) lv_timer_pause(refrTimer);
+    pauseInputPolling(true);
+}
+
+void RootContainer::pauseInputPolling(bool pause) {
+    /* the uv poll on the input device keeps reading events and wakes us up */
+    lv_indev_t* indevs[] = {mResult.indev, mResult.utouch_indev};
+    for (auto indev : indevs) {
+        lv_timer_t* timer = indev ? lv_indev_get_read_timer(indev) : nullptr;
+        if (!timer) continue;
+
+        if (pause) {
+            lv_timer_pause(timer);
+        } else {
+            lv_timer_resume(timer);
+        }
+    }
+}
+
 void RootContainer::processVsyncEvent() {
     WM_PROFILER_BEGIN();
+#ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
+    if (mVsyncLead > 0) {
+        /* compose mVsyncLead after the apps woke up, not a whole period later */
+        lv_timer_t* refrTimer = lv_display_get_refr_timer(mDisp);
+        if (refrTimer) refrTimer->last_run = lv_tick_get() - (refrTimer->period - mVsyncLead);
+    }
+#endif
     if (mListener) {
         mListener->responseVsync();
     }
@@ -179,6 +280,13 @@ static bool monitor_indev_read(lv_indev_t* indev, lv_indev_data_t* data) {
 }
 
 bool RootContainer::readInput(lv_indev_t* indev, lv_indev_data_t* data) {
+    /* stay awake until the pointer or key is released */
+    mInputPressed = data->state == LV_INDEV_STATE_PRESSED;
+    if (mInputPressed) wakeUp();
+
+    /* the windows get it through lvgl events of this read, see stampInput */
+    mInputTime = curSysTimeUs();
+    if (++mInputSeq == 0) mInputSeq = 1;
     if (!mListener) return false;
 
     int type = lv_indev_get_type(indev);
@@ -199,6 +307,7 @@ bool RootContainer::readInput(lv_indev_t* indev, lv_indev_data_t* data) {
 
     msg.type = (InputMessageType)type;
     msg.state = (InputMessageState)data->state;
+    stampInput(&msg);
     return mListener->responseInput(&msg);
 }
 
@@ -232,20 +341,34 @@ static void processDispEvent(lv_event_t* e) {
             container->onFrameFinished();
             break;
         }
+
+        case LV_EVENT_REFR_REQUEST: {
+            CONTAINER_FROM_EVENT(e);
+            container->wakeUp();
+            break;
+        }
         default:
             break;
     }
 }
 
 void RootContainer::onFrameStart() {
+    mFrameStartTime = curSysTimeUs();
     auto info = frameInfo();
     if (info) {
         info->setVsync(FrameMetaInfo::getCurSysTime(), 0, LV_DEF_REFR_PERIOD);
         info->markLayoutStart();
     }
 
+    /* before the invalid areas are collected, so new buffers join this refresh */
+    if (mListener) mListener->responseFrameStart();
+
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
-    if (!mVsyncTimer->paused) {
+    /*
+     * align to the refresh only at full rate without a phase lead, a divided
+     * timer counts periods and a lead timer drives the composition itself
+     */
+    if (!mVsyncTimer->paused && mVsyncDivisor == 1 && mVsyncLead == 0) {
         lv_timer_reset(mVsyncTimer);
         if (mVsyncTimer->timer_cb) mVsyncTimer->timer_cb(mVsyncTimer);
     }
@@ -258,6 +381,8 @@ void RootContainer::onRenderStart() {
 }
 
 void RootContainer::onFrameFinished() {
+    mFrameOverrun = curSysTimeUs() - mFrameStartTime > getVsyncPeriod();
+    updateIdleState();
     if (!mTraceFrame) return;
 
     mFrameInfo.markRenderEnd();
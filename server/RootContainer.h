@@ -26,6 +26,12 @@
 namespace os {
 namespace wm {
 
+enum ContainerState {
+    CONTAINER_STATE_ACTIVE = 0,
+    /* nothing to compose, vsync, refresh and input polling are stopped */
+    CONTAINER_STATE_IDLE,
+};
+
 class RootContainer {
 public:
     RootContainer(DeviceEventListener* listener, uv_loop_t* loop);
@@ -39,18 +45,47 @@ public:
     bool getDisplayInfo(DisplayInfo* info);
 
     void enableVsync(bool enable);
+    /* run the vsync timer at every Nth display period */
+    void setVsyncDivisor(uint32_t divisor);
+    uint32_t getVsyncDivisor() {
+        return mVsyncDivisor;
+    }
     void processVsyncEvent();
+    /* make sure the display refreshes, pending transactions latch at its start */
+    void scheduleRefresh();
+    /* leave the idle state on a transaction, an input event or an animation */
+    void wakeUp();
+    bool isIdle() {
+        return mState == CONTAINER_STATE_IDLE;
+    }
 
     void showToast(const char* text, uint32_t duration);
 
     bool readInput(lv_indev_t* drv, lv_indev_data_t* data);
+    /* with the latest sample read from the input device */
+    void stampInput(InputMessage* msg) {
+        msg->seq = mInputSeq;
+        msg->timestamp = mInputTime;
+    }
 
     bool vsyncEnabled() {
         return mVsyncEnabled;
     }
+    /* in us */
+    uint32_t getVsyncPeriod() {
+        return LV_DEF_REFR_PERIOD * 1000;
+    }
+    /* how long the composition runs after the app vsync, in us */
+    uint32_t getVsyncLead() {
+        return mVsyncLead * 1000;
+    }
     bool ready() {
         return mReady;
     }
+    /* the last refresh took longer than a display period */
+    bool frameOverrun() {
+        return mFrameOverrun;
+    }
 
     FrameMetaInfo* frameInfo();
 
@@ -61,11 +96,16 @@ public:
 
 private:
     bool init();
+    void updateVsyncPhase();
+    void updateIdleState();
+    void pauseInputPolling(bool pause);
     lv_nuttx_result_t mResult;
 
     DeviceEventListener* mListener;
     lv_disp_t* mDisp;
     bool mVsyncEnabled;
+    uint32_t mVsyncDivisor;
+    uint32_t mVsyncLead;
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
     lv_timer_t* mVsyncTimer;
 #endif
@@ -73,6 +113,12 @@ private:
     uv_loop_t* mUvLoop;
     bool mReady;
     bool mTraceFrame;
+    ContainerState mState;
+    uint64_t mFrameStartTime;
+    bool mFrameOverrun;
+    bool mInputPressed;
+    uint32_t mInputSeq;
+    uint64_t mInputTime;
     FrameMetaInfo mFrameInfo;
     FrameTimeInfo mFrameTimeInfo;
 };
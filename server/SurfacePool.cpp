@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WMS:SurfacePool"
+
+#include "SurfacePool.h"
+
+#include "../common/WindowUtils.h"
+#include "wm/SurfaceControl.h"
+
+namespace os {
+namespace wm {
+
+SurfacePool::SurfacePool(uint32_t capacity) : mCapacity(capacity) {}
+
+SurfacePool::~SurfacePool() {
+    for (auto& entry : mSurfaces) {
+        destroy(entry.mSurface);
+    }
+    mSurfaces.clear();
+}
+
+void SurfacePool::destroy(const std::shared_ptr<SurfaceControl>& sc) {
+    uninitSurfaceBuffer(sc, true);
+    sc->setBufferQueue(nullptr);
+}
+
+void SurfacePool::recycle(int32_t pid, const std::shared_ptr<SurfaceControl>& sc) {
+    if (sc.get() == nullptr) return;
+
+    if (mCapacity == 0 || !sc->isValid()) {
+        destroy(sc);
+        return;
+    }
+
+    /* evict the oldest one */
+    if (mSurfaces.size() >= mCapacity) {
+        destroy(mSurfaces.front().mSurface);
+        mSurfaces.erase(mSurfaces.begin());
+    }
+
+    FLOGI("[%" PRId32 "] park surface %p, size=%" PRIu32 "", pid, sc.get(), sc->getBufferSize());
+    mSurfaces.push_back({pid, sc});
+}
+
+std::shared_ptr<SurfaceControl> SurfacePool::obtain(int32_t pid, uint32_t size, uint32_t format,
+                                                    uint32_t bufferCount) {
+    /* newest first, it is most likely still resident */
+    for (auto it = mSurfaces.rbegin(); it != mSurfaces.rend(); ++it) {
+        auto sc = it->mSurface;
+        if (it->mPid == pid && sc->getBufferSize() == size && sc->getFormat() == format &&
+            sc->bufferIds().size() == bufferCount) {
+            mSurfaces.erase(std::next(it).base());
+            FLOGI("[%" PRId32 "] reuse surface %p, size=%" PRIu32 "", pid, sc.get(), size);
+            return sc;
+        }
+    }
+    return nullptr;
+}
+
+void SurfacePool::clear(int32_t pid) {
+    for (auto it = mSurfaces.begin(); it != mSurfaces.end();) {
+        if (it->mPid == pid) {
+            destroy(it->mSurface);
+            it = mSurfaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint32_t SurfacePool::getSurfaceBytes(int32_t pid) {
+    uint32_t bytes = 0;
+    for (auto& entry : mSurfaces) {
+        if (entry.mPid == pid) {
+            bytes += entry.mSurface->bufferIds().size() * entry.mSurface->getBufferSize();
+        }
+    }
+    return bytes;
+}
+
+} // namespace wm
+} // namespace os
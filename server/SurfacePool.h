@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <nuttx/config.h>
+
+#include <memory>
+#include <vector>
+
+namespace os {
+namespace wm {
+
+class SurfaceControl;
+
+/*
+ * Surfaces dropped by relayout are parked here with their shared memory and
+ * fmq still mapped, a later surface of the same process, size and format
+ * takes them over instead of creating new segments.
+ */
+class SurfacePool {
+public:
+    SurfacePool(uint32_t capacity);
+    ~SurfacePool();
+
+    void recycle(int32_t pid, const std::shared_ptr<SurfaceControl>& sc);
+    std::shared_ptr<SurfaceControl> obtain(int32_t pid, uint32_t size, uint32_t format,
+                                           uint32_t bufferCount);
+    void clear(int32_t pid);
+    uint32_t getSurfaceBytes(int32_t pid);
+
+    uint32_t size() {
+        return mSurfaces.size();
+    }
+
+private:
+    typedef struct {
+        int32_t mPid;
+        std::shared_ptr<SurfaceControl> mSurface;
+    } PoolEntry;
+
+    void destroy(const std::shared_ptr<SurfaceControl>& sc);
+
+    uint32_t mCapacity;
+    std::vector<PoolEntry> mSurfaces;
+};
+
+} // namespace wm
+} // namespace os
@@ -29,6 +29,7 @@
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #endif
+#include <algorithm>
 #include <random>
 
 #include "../common/WindowUtils.h"
@@ -208,6 +209,9 @@ void WindowManagerService::WindowDeathRecipient::binderDied(const wp<IBinder>& w
     if (it != mService->mWindowMap.end()) {
         it->second->removeIfPossible();
     }
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    mService->removeVsyncSubscriber(key);
+#endif
 }
 
 WindowManagerService::WindowManagerService(std::shared_ptr<::os::app::UvLoop> uvLooper)
@@ -215,7 +219,10 @@ WindowManagerService::WindowManagerService(std::shared_ptr<::os::app::UvLoop> uv
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
         mWinAnimEngine(nullptr),
 #endif
-        mGestureDetector(mUvLooper) {
+        mGestureDetector(mUvLooper),
+        mSurfacePool(CONFIG_ENABLE_WINDOW_SURFACE_POOL_MAX),
+        mFocusedWindow(nullptr),
+        mVsyncSeq(0) {
     FLOGI("WMS init");
     mContainer = new RootContainer(this, mUvLooper->get());
     DisplayInfo disp_info;
@@ -225,6 +232,11 @@ WindowManagerService::WindowManagerService(std::shared_ptr<::os::app::UvLoop> uv
     if (!ready()) return;
 
     mWindowDeathRecipient = sp<WindowDeathRecipient>::make(this);
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    if (!mVsyncPage.createPage(genUniquePath(false, getpid(), "vsync"))) {
+        FLOGW("no vsync page, vsync is sent by binder");
+    }
+#endif
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     mWinAnimEngine = new WindowAnimEngine();
     int ret = parseAnimJsonFile(animConfigPath.c_str());
@@ -307,6 +319,7 @@ Status WindowManagerService::addWindow(const sp<IWindow>& window, const LayoutPa
 
     WindowState* win = new WindowState(this, window, winToken, attrs, visibility,
                                        outInputChannel != nullptr ? true : false);
+    win->setClientPid(pid);
     client->linkToDeath(mWindowDeathRecipient);
     mWindowMap.emplace(client, win);
     winToken->addWindow(win);
@@ -363,23 +376,24 @@ Status WindowManagerService::relayout(const sp<IWindow>& window, const LayoutPar
     }
 
     bool visible = visibility == LayoutParams::WINDOW_VISIBLE ? true : false;
-    win->destroySurfaceControl();
-
-    if (visible) {
-        if (attrs.mWidth != requestedWidth || attrs.mHeight != requestedHeight) {
-            LayoutParams newAttrs = attrs;
-            newAttrs.mWidth = requestedWidth;
-            newAttrs.mHeight = requestedHeight;
-            win->setLayoutParams(newAttrs);
-        } else {
-            win->setLayoutParams(attrs);
-        }
+    LayoutParams newAttrs = attrs;
+    newAttrs.mWidth = requestedWidth;
+    newAttrs.mHeight = requestedHeight;
+
+    if (visible && win->isSurfaceReusable(newAttrs)) {
+        /* geometry is unchanged, keep buffers and fmq */
+        win->setLayoutParams(newAttrs);
+        outSurfaceControl->copyFrom(*win->getSurfaceControl());
+    } else if (visible) {
+        mSurfacePool.recycle(win->getClientPid(), win->detachSurfaceControl());
+        win->setLayoutParams(newAttrs);
         *_aidl_return = createSurfaceControl(outSurfaceControl, win);
         if (*_aidl_return != 0) {
             FLOGE("failure, cann't create valid surface!");
             outSurfaceControl = nullptr;
         }
     } else {
+        mSurfacePool.recycle(win->getClientPid(), win->detachSurfaceControl());
         outSurfaceControl = nullptr;
     }
 
@@ -391,6 +405,55 @@ Status WindowManagerService::relayout(const sp<IWindow>& window, const LayoutPar
             : Status::fromExceptionCode(2, "now no valid surface, please retry it!");
 }
 
+Status WindowManagerService::updateBufferCount(const sp<IWindow>& window, int32_t bufferCount,
+                                               SurfaceControl* outSurfaceControl,
+                                               int32_t* _aidl_return) {
+    WM_PROFILER_BEGIN();
+
+    *_aidl_return = -1;
+
+#ifdef CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER
+    int32_t pid = IPCThreadState::self()->getCallingPid();
+    auto it = mWindowMap.find(IInterface::asBinder(window));
+    WindowState* win = it != mWindowMap.end() ? it->second : nullptr;
+    std::shared_ptr<SurfaceControl> surfaceControl = win ? win->getSurfaceControl() : nullptr;
+    std::shared_ptr<BufferConsumer> consumer = win ? win->getBufferConsumer() : nullptr;
+
+    if (surfaceControl == nullptr || consumer == nullptr) {
+        FLOGW("[%" PRId32 "] window(%p) has no surface", pid, window.get());
+        WM_PROFILER_END();
+        return Status::fromExceptionCode(1, "no valid surface");
+    }
+
+    uint32_t count = DATA_CLAMP(bufferCount, 2, 3);
+    std::vector<BufferId> ids = surfaceControl->bufferIds();
+
+    if (ids.size() < count &&
+        !reserveSurfaceBytes(pid, (count - ids.size()) * surfaceControl->getBufferSize())) {
+        FLOGW("[%" PRId32 "] window(%p) can't grow buffers, out of surface budget", pid,
+              window.get());
+    } else if (ids.size() < count) {
+        for (uint32_t i = ids.size(); i < count; i++) {
+            std::string bufferPath = genUniquePath(false, pid, "bq");
+            ids.push_back({bufferPath, getRandomNumber(), -1});
+        }
+        win->updateSurfaceBuffers(ids);
+    } else if (ids.size() > count) {
+        /* the client asks for it, so the buffer is free on both sides */
+        win->dropFreeBuffer();
+    }
+
+    FLOGI("[%" PRId32 "] window(%p) buffer count %" PRIu32 " -> %zu", pid, window.get(), count,
+          surfaceControl->bufferIds().size());
+    outSurfaceControl->copyFrom(*surfaceControl);
+    *_aidl_return = 0;
+#endif
+
+    WM_PROFILER_END();
+    return *_aidl_return == 0 ? Status::ok()
+                              : Status::fromExceptionCode(1, "adaptive buffer is disabled");
+}
+
 Status WindowManagerService::isWindowToken(const sp<IBinder>& binder, bool* _aidl_return) {
     WM_PROFILER_BEGIN();
 
@@ -469,10 +532,13 @@ Status WindowManagerService::updateWindowTokenVisibility(const sp<IBinder>& toke
 Status WindowManagerService::applyTransaction(const vector<LayerState>& state) {
     WM_PROFILER_BEGIN();
     for (const auto& layerState : state) {
-        if (mWindowMap.find(layerState.mToken) != mWindowMap.end()) {
-            mWindowMap[layerState.mToken]->applyTransaction(layerState);
+        auto it = mWindowMap.find(layerState.mToken);
+        if (it != mWindowMap.end()) {
+            it->second->queueTransaction(layerState);
         }
     }
+    /* applied together when the next refresh starts */
+    if (!mPendingWindows.empty()) mContainer->scheduleRefresh();
     WM_PROFILER_END();
     return Status::ok();
 }
@@ -480,6 +546,12 @@ Status WindowManagerService::applyTransaction(const vector<LayerState>& state) {
 Status WindowManagerService::requestVsync(const sp<IWindow>& window, VsyncRequest vreq) {
     WM_PROFILER_BEGIN();
     FLOGD("%p vreq=%s", window.get(), VsyncRequestToString(vreq));
+    if (!isValidVsync(vreq)) {
+        WM_PROFILER_END();
+        FLOGW("%p invalid vreq=%" PRId32 "!", window.get(), static_cast<int32_t>(vreq));
+        return Status::fromExceptionCode(1, "invalid vsync request");
+    }
+
     sp<IBinder> client = IInterface::asBinder(window);
     auto it = mWindowMap.find(client);
 
@@ -533,6 +605,60 @@ Status WindowManagerService::releaseInput(const sp<IBinder>& token) {
     return Status::fromExceptionCode(1, "no specified input monitor");
 }
 
+Status WindowManagerService::registerVsyncChannel(const sp<IBinder>& token,
+                                                  VsyncChannel* _aidl_return) {
+    int32_t pid = IPCThreadState::self()->getCallingPid();
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    auto channel = std::make_shared<VsyncChannel>();
+    if (!channel->attach(mVsyncPage)) {
+        FLOGW("[%" PRId32 "] no vsync channel", pid);
+        return Status::fromExceptionCode(2, "create vsync channel failure!");
+    }
+
+    /* a process has one subscription, the latest one wins */
+    auto it = mVsyncSubscribers.find(pid);
+    if (it != mVsyncSubscribers.end()) {
+        it->second.mToken->unlinkToDeath(mWindowDeathRecipient);
+        mVsyncSubscribers.erase(it);
+    }
+
+    token->linkToDeath(mWindowDeathRecipient);
+    mVsyncSubscribers[pid] = {token, channel, false};
+    _aidl_return->copyFrom(*channel);
+
+    FLOGI("[%" PRId32 "] vsync channel %d", pid, channel->getEventFd());
+    return Status::ok();
+#else
+    FLOGW("[%" PRId32 "] vsync channel is disabled", pid);
+    return Status::fromExceptionCode(1, "vsync channel is disabled");
+#endif
+}
+
+Status WindowManagerService::unregisterVsyncChannel(const sp<IBinder>& token) {
+    FLOGI("[%" PRId32 "]", IPCThreadState::self()->getCallingPid());
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    if (removeVsyncSubscriber(token)) {
+        return Status::ok();
+    }
+#endif
+    return Status::fromExceptionCode(1, "no specified vsync channel");
+}
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+bool WindowManagerService::removeVsyncSubscriber(const sp<IBinder>& token) {
+    for (auto it = mVsyncSubscribers.begin(); it != mVsyncSubscribers.end(); ++it) {
+        if (it->second.mToken == token) {
+            it->second.mToken->unlinkToDeath(mWindowDeathRecipient);
+            mVsyncSubscribers.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
 void WindowManagerService::postWindowRemoveCleanup(WindowState* state) {
     mUvLooper->postTask([this, state]() {
         sp<IBinder> binder = IInterface::asBinder(state->getClient());
@@ -540,6 +666,9 @@ void WindowManagerService::postWindowRemoveCleanup(WindowState* state) {
 
         if (token && token.get()) token->removeWindow(state);
 
+        /* drop parked surfaces, the process may be gone */
+        mSurfacePool.clear(state->getClientPid());
+
         auto itState = mWindowMap.find(binder);
         if (itState != mWindowMap.end()) {
             itState->first->unlinkToDeath(mWindowDeathRecipient);
@@ -567,27 +696,168 @@ bool WindowManagerService::responseInput(InputMessage* msg) {
     return has_gesture;
 }
 
+void WindowManagerService::addVsyncWindow(WindowState* state) {
+    if (state->getVsyncIndex() >= 0) return;
+
+    state->setVsyncIndex(mVsyncWindows.size());
+    mVsyncWindows.push_back(state);
+}
+
+void WindowManagerService::removeVsyncWindow(WindowState* state) {
+    int32_t index = state->getVsyncIndex();
+    if (index < 0) return;
+
+    WindowState* last = mVsyncWindows.back();
+    mVsyncWindows[index] = last;
+    last->setVsyncIndex(index);
+    mVsyncWindows.pop_back();
+    state->setVsyncIndex(-1);
+
+    /* nothing left to animate, stop at once instead of on the next tick */
+    if (mVsyncWindows.empty()) {
+        mContainer->enableVsync(false);
+    }
+}
+
+void WindowManagerService::addPendingWindow(WindowState* state) {
+    mPendingWindows.push_back(state);
+}
+
+void WindowManagerService::removePendingWindow(WindowState* state) {
+    auto it = std::find(mPendingWindows.begin(), mPendingWindows.end(), state);
+    if (it != mPendingWindows.end()) mPendingWindows.erase(it);
+}
+
+bool WindowManagerService::responseFrameStart() {
+    if (mPendingWindows.empty()) return false;
+    WM_PROFILER_BEGIN();
+
+    /* latch every window at once, the refresh composes them consistently */
+    std::vector<WindowState*> windows;
+    windows.swap(mPendingWindows);
+    for (auto state : windows) {
+        state->latchTransaction();
+    }
+
+    WM_PROFILER_END();
+    return true;
+}
+
+bool WindowManagerService::responseIdle() {
+    if (!mPendingWindows.empty()) return false;
+
+#ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
+    /* transition animations invalidate the widgets on their own timers */
+    for (const auto& [token, state] : mWindowMap) {
+        if (state->isAnimating()) return false;
+    }
+#endif
+    return true;
+}
+
 bool WindowManagerService::responseVsync() {
     WM_PROFILER_BEGIN();
 
-    VsyncRequest nextVsync = VsyncRequest::VSYNC_REQ_NONE;
-    for (const auto& [key, state] : mWindowMap) {
+    FrameTimeline timeline = makeFrameTimeline(curSysTimeUs(), mContainer->getVsyncPeriod(),
+                                               mContainer->getVsyncLead());
+
+    /* a divided timer skips periods, keep the tick a multiple of the divisor */
+    uint32_t divisor = mContainer->getVsyncDivisor();
+    mVsyncSeq = (mVsyncSeq / divisor + 1) * divisor;
+
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    if (!mVsyncSubscribers.empty()) {
+        mVsyncPage.publish(mVsyncSeq, timeline);
+    }
+#endif
+
+    sortVsyncWindows();
+#ifdef CONFIG_WINDOW_VSYNC_DEFER_LOW_PRIORITY
+    /* the last composition was late, let the windows below the top one wait a tick */
+    int32_t topPriority = mVsyncWindows.empty() ? 0 : mVsyncWindows.back()->getVsyncPriority();
+    bool overrun = mContainer->frameOverrun();
+#endif
+
+    uint32_t nextDivisor = 0;
+    /*
+     * backwards from the highest priority, a window that is done leaves by
+     * swapping the last one in, which has been served already
+     */
+    for (size_t i = mVsyncWindows.size(); i-- > 0;) {
+        WindowState* state = mVsyncWindows[i];
         if (state->isVisible()) {
-            VsyncRequest result = state->onVsync();
-            if (result > nextVsync) {
-                nextVsync = result;
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+            auto it = mVsyncSubscribers.find(state->getClientPid());
+#endif
+#ifdef CONFIG_WINDOW_VSYNC_DEFER_LOW_PRIORITY
+            bool deferrable = overrun && state->getVsyncPriority() < topPriority;
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+            /* a woken process draws all its windows, none of them is left behind */
+            deferrable = deferrable && (it == mVsyncSubscribers.end() || !it->second.mPending);
+#endif
+            if (deferrable && state->deferVsync()) {
+                nextDivisor = 1;
+                continue;
+            }
+#endif
+            bool broadcast = false;
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+            if (it != mVsyncSubscribers.end()) {
+                broadcast = true;
+                /* one wakeup per process, it dispatches the frame to its windows */
+                if (state->isVsyncDue(mVsyncSeq) && !it->second.mPending) {
+                    it->second.mPending = true;
+                    it->second.mChannel->signal();
+                }
+            }
+#endif
+            VsyncRequest result = state->onVsync(mVsyncSeq, broadcast, timeline);
+            if (result != VsyncRequest::VSYNC_REQ_NONE) {
+                nextDivisor = vsyncGcd(nextDivisor, vsyncDivisor(result));
             }
         }
     }
 
-    if (nextVsync == VsyncRequest::VSYNC_REQ_NONE) {
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+#ifdef CONFIG_WINDOW_VSYNC_DEFER_LOW_PRIORITY
+    /* a window deferred before a lower one woke its process draws with it, serve it now */
+    for (size_t i = mVsyncWindows.size(); i-- > 0;) {
+        WindowState* state = mVsyncWindows[i];
+        auto it = mVsyncSubscribers.find(state->getClientPid());
+        if (state->isVsyncDeferred() && it != mVsyncSubscribers.end() && it->second.mPending) {
+            VsyncRequest result = state->onVsync(mVsyncSeq, true, timeline);
+            if (result != VsyncRequest::VSYNC_REQ_NONE) {
+                nextDivisor = vsyncGcd(nextDivisor, vsyncDivisor(result));
+            }
+        }
+    }
+#endif
+    for (auto& [pid, subscriber] : mVsyncSubscribers) {
+        subscriber.mPending = false;
+    }
+#endif
+
+    if (nextDivisor == 0) {
         mContainer->enableVsync(false);
+    } else {
+        /* the slowest timer serving every request */
+        mContainer->setVsyncDivisor(nextDivisor);
     }
 
     WM_PROFILER_END();
     return true;
 }
 
+void WindowManagerService::sortVsyncWindows() {
+    /* ascending, the dispatch runs backwards to serve the highest priority first */
+    std::sort(mVsyncWindows.begin(), mVsyncWindows.end(), [](WindowState* a, WindowState* b) {
+        return a->getVsyncPriority() < b->getVsyncPriority();
+    });
+    for (size_t i = 0; i < mVsyncWindows.size(); i++) {
+        mVsyncWindows[i]->setVsyncIndex(i);
+    }
+}
+
 int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceControl,
                                                    WindowState* win) {
     vector<BufferId> ids;
@@ -598,6 +868,27 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     bufferCount = 3;
 #endif
 
+    std::shared_ptr<SurfaceControl> surfaceControl =
+            mSurfacePool.obtain(win->getClientPid(), win->getSurfaceSize(),
+                                win->getLayoutParams().mFormat, bufferCount);
+    if (surfaceControl != nullptr) {
+        win->attachSurfaceControl(surfaceControl);
+        outSurfaceControl->copyFrom(*surfaceControl);
+        return 0;
+    }
+
+    /* over budget, fall back to fewer buffers before refusing the surface */
+    uint32_t surfaceSize = win->getSurfaceSize();
+    while (!reserveSurfaceBytes(win->getClientPid(), surfaceSize * bufferCount)) {
+        if (bufferCount <= 2) {
+            FLOGE("[%" PRId32 "] exceed surface memory budget, %" PRIu32 " bytes in use",
+                  win->getClientPid(), getSurfaceBytes(win->getClientPid()));
+            outSurfaceControl = nullptr;
+            return -1;
+        }
+        bufferCount--;
+    }
+
     for (int32_t i = 0; i < bufferCount; i++) {
         BufferId id;
         std::string bufferPath = genUniquePath(false, pid, "bq");
@@ -609,7 +900,7 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     }
 
     std::string fmqName = genUniquePath(false, pid, "fakemq");
-    std::shared_ptr<SurfaceControl> surfaceControl = win->createSurfaceControl(ids, fmqName);
+    surfaceControl = win->createSurfaceControl(ids, fmqName);
 
     if (!surfaceControl->isValid()) {
         outSurfaceControl = nullptr;
@@ -623,6 +914,31 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     return 0;
 }
 
+uint32_t WindowManagerService::getSurfaceBytes(int32_t pid) {
+    uint32_t bytes = mSurfacePool.getSurfaceBytes(pid);
+    for (auto& it : mTokenMap) {
+        if (it.second->getClientPid() == pid) {
+            bytes += it.second->getSurfaceBytes();
+        }
+    }
+    return bytes;
+}
+
+bool WindowManagerService::reserveSurfaceBytes(int32_t pid, uint32_t bytes) {
+    uint32_t budget = CONFIG_ENABLE_WINDOW_SURFACE_BUDGET * 1024;
+    if (budget == 0 || getSurfaceBytes(pid) + bytes <= budget) {
+        return true;
+    }
+
+    /* parked surfaces belong to hidden windows, drop them first */
+    mSurfacePool.clear(pid);
+    uint32_t used = getSurfaceBytes(pid);
+    /* buffers of shown windows are only given back by their clients, see updateBufferCount */
+    FLOGW("[%" PRId32 "] surface memory %" PRIu32 " + %" PRIu32 " over budget %" PRIu32 "", pid,
+          used, bytes, budget);
+    return used + bytes <= budget;
+}
+
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
 AnimEngineHandle WindowManagerService::getAnimEngine() {
     return mWinAnimEngine->getEngine();
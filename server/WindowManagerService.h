@@ -22,9 +22,11 @@
 
 #include "DeviceEventListener.h"
 #include "GestureDetector.h"
+#include "SurfacePool.h"
 #include "WindowConfig.h"
 #include "app/UvLoop.h"
 #include "os/wm/BnWindowManager.h"
+#include "wm/VsyncChannel.h"
 
 namespace os {
 namespace wm {
@@ -59,6 +61,8 @@ public:
     Status relayout(const sp<IWindow>& window, const LayoutParams& attrs, int32_t requestedWidth,
                     int32_t requestedHeight, int32_t visibility, SurfaceControl* outSurfaceControl,
                     int32_t* _aidl_return);
+    Status updateBufferCount(const sp<IWindow>& window, int32_t bufferCount,
+                             SurfaceControl* outSurfaceControl, int32_t* _aidl_return);
 
     Status isWindowToken(const sp<IBinder>& binder, bool* _aidl_return);
     Status addWindowToken(const sp<IBinder>& token, int32_t type, int32_t displayId);
@@ -70,9 +74,13 @@ public:
     Status monitorInput(const sp<IBinder>& token, const ::std::string& name, int32_t displayId,
                         InputChannel* outInputChannel);
     Status releaseInput(const sp<IBinder>& token);
+    Status registerVsyncChannel(const sp<IBinder>& token, VsyncChannel* _aidl_return);
+    Status unregisterVsyncChannel(const sp<IBinder>& token);
 
     bool responseVsync() override;
     bool responseInput(InputMessage* msg) override;
+    bool responseFrameStart() override;
+    bool responseIdle() override;
 
     RootContainer* getRootContainer() {
         return mContainer;
@@ -84,6 +92,19 @@ public:
 #endif
 
     void postWindowRemoveCleanup(WindowState* state);
+    // windows waiting for vsync, the only ones visited on a vsync tick
+    void addVsyncWindow(WindowState* state);
+    void removeVsyncWindow(WindowState* state);
+    // windows with transactions waiting for the next composition
+    void addPendingWindow(WindowState* state);
+    void removePendingWindow(WindowState* state);
+    // the window last touched by the user, its frames are dispatched first
+    WindowState* getFocusedWindow() {
+        return mFocusedWindow;
+    }
+    void setFocusedWindow(WindowState* state) {
+        mFocusedWindow = state;
+    }
     bool removeWindowTokenInner(sp<IBinder>& token);
 
     bool ready();
@@ -99,6 +120,12 @@ private:
     };
 
     int32_t createSurfaceControl(SurfaceControl* outSurfaceControl, WindowState* win);
+    uint32_t getSurfaceBytes(int32_t pid);
+    bool reserveSurfaceBytes(int32_t pid, uint32_t bytes);
+    void sortVsyncWindows();
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    bool removeVsyncSubscriber(const sp<IBinder>& token);
+#endif
 
     WindowTokenMap mTokenMap;
     WindowStateMap mWindowMap;
@@ -110,6 +137,22 @@ private:
     WindowAnimEngine* mWinAnimEngine;
 #endif
     GestureDetector mGestureDetector;
+    SurfacePool mSurfacePool;
+#ifdef CONFIG_ENABLE_WINDOW_VSYNC_CHANNEL
+    typedef struct {
+        sp<IBinder> mToken;
+        std::shared_ptr<VsyncChannel> mChannel;
+        bool mPending;
+    } VsyncSubscriber;
+
+    VsyncChannel mVsyncPage;
+    map<int32_t, VsyncSubscriber> mVsyncSubscribers;
+#endif
+    std::vector<WindowState*> mVsyncWindows;
+    std::vector<WindowState*> mPendingWindows;
+    WindowState* mFocusedWindow;
+    /* vsync tick in display periods, rate divided requests are due on its multiples */
+    uint32_t mVsyncSeq;
 };
 
 } // namespace wm
@@ -133,29 +133,33 @@ void WindowNode::resetOpaque() {
     lv_obj_set_style_opa(mWidget, 0xFF, LV_PART_MAIN);
 }
 
-bool WindowNode::updateBuffer(BufferItem* item, Rect* rect, uint32_t seq) {
+bool WindowNode::updateBuffer(BufferItem* item, Region* region, uint32_t seq) {
     WM_PROFILER_BEGIN();
 
     bool result = false;
-    lv_area_t area;
+    lv_area_t areas[REGION_MAX_RECTS];
+    uint32_t count = 0;
     lv_mainwnd_buf_dsc_t dsc;
     BufferItem* oldBuffer = mBuffer;
 
     mBuffer = item;
-    if (rect) {
-        area.x1 = rect->left;
-        area.y1 = rect->top;
-        area.y2 = rect->bottom;
-        area.x2 = rect->right;
+    if (region) {
+        for (const auto& rect : *region) {
+            areas[count].x1 = rect.left;
+            areas[count].y1 = rect.top;
+            areas[count].x2 = rect.right;
+            areas[count].y2 = rect.bottom;
+            count++;
+        }
     }
 
     if (mBuffer) {
         initBufDsc(&dsc, mBuffer->mKey, mRect.getWidth(), mRect.getHeight(), getColorFormat(),
                    mBuffer->mSize, mBuffer->mBuffer);
         dsc.seq = seq;
-        result = lv_mainwnd_update_buffer(mWidget, &dsc, rect ? &area : nullptr);
+        result = lv_mainwnd_update_buffer(mWidget, &dsc, region ? areas : NULL, count);
     } else {
-        result = lv_mainwnd_update_buffer(mWidget, NULL, NULL);
+        result = lv_mainwnd_update_buffer(mWidget, NULL, NULL, 0);
     }
 
     FLOGD("(%p) %s from(0x%0" PRIx32 ") to(0x%0" PRIx32 ") seq=%" PRIu32 "\n", this,
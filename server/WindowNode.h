@@ -20,6 +20,7 @@
 #include "lvgl/lv_mainwnd.h"
 #include "wm/InputMessage.h"
 #include "wm/Rect.h"
+#include "wm/Region.h"
 
 namespace os {
 namespace wm {
@@ -30,7 +31,7 @@ public:
                int32_t format);
     ~WindowNode();
 
-    bool updateBuffer(BufferItem* item, Rect* rect, uint32_t seq);
+    bool updateBuffer(BufferItem* item, Region* region, uint32_t seq);
 
     BufferItem* acquireBuffer();
     bool releaseBuffer();
@@ -21,6 +21,7 @@
 #include <sys/mman.h>
 #include <utils/RefBase.h>
 
+#include <algorithm>
 #include <map>
 
 #include "../common/WindowUtils.h"
@@ -47,6 +48,26 @@ static inline void* getLayerByType(WindowManagerService* service, int type) {
     }
 }
 
+/* z-order of the layers picked by getLayerByType */
+static inline int32_t getLayerPriority(int type) {
+    switch (type) {
+        case LayoutParams::TYPE_DIALOG: {
+            return 2;
+        }
+        case LayoutParams::TYPE_SYSTEM_WINDOW:
+        case LayoutParams::TYPE_TOAST: {
+            return 1;
+        }
+        case LayoutParams::TYPE_APPLICATION:
+        default: {
+            return 0;
+        }
+    }
+}
+
+#define VSYNC_PRIORITY_FOCUSED 8
+#define VSYNC_PRIORITY_INVISIBLE -1
+
 WindowState::WindowState(WindowManagerService* service, const sp<IWindow>& window,
                          std::shared_ptr<WindowToken> token, const LayoutParams& params,
                          int32_t visibility, bool enableInput)
@@ -55,10 +76,13 @@ WindowState::WindowState(WindowManagerService* service, const sp<IWindow>& windo
         mService(service),
         mInputDispatcher(nullptr),
         mVsyncRequest(VsyncRequest::VSYNC_REQ_NONE),
+        mVsyncIndex(-1),
+        mVsyncDeferred(false),
         mFrameReq(0),
         mHasSurface(false),
         mFlags(0),
-        mNeedInput(enableInput) {
+        mNeedInput(enableInput),
+        mClientPid(-1) {
     mAttrs = params;
     mVisibility = visibility;
 
@@ -75,6 +99,9 @@ WindowState::WindowState(WindowManagerService* service, const sp<IWindow>& windo
 
 WindowState::~WindowState() {
     FLOGI("%p", this);
+    mService->removeVsyncWindow(this);
+    if (!mPendingStates.empty()) mService->removePendingWindow(this);
+    if (mService->getFocusedWindow() == this) mService->setFocusedWindow(nullptr);
     mClient = nullptr;
     if (mNode) delete mNode;
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
@@ -100,8 +127,14 @@ std::shared_ptr<InputDispatcher> WindowState::createInputDispatcher(const std::s
 }
 
 bool WindowState::sendInputMessage(const InputMessage* ie) {
-    if (mInputDispatcher != nullptr) return mInputDispatcher->sendMessage(ie);
-    return false;
+    /* the window being touched is served first on the next vsync */
+    if (ie->state == INPUT_MESSAGE_STATE_PRESSED) mService->setFocusedWindow(this);
+    if (mInputDispatcher == nullptr) return false;
+
+    /* the device sample it comes from, the client times the frame showing it */
+    InputMessage msg = *ie;
+    mService->getRootContainer()->stampInput(&msg);
+    return mInputDispatcher->sendMessage(&msg);
 }
 
 void WindowState::setVisibility(int32_t visibility) {
@@ -132,6 +165,7 @@ void WindowState::sendAppVisibilityToClients(int32_t visibility) {
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
             if (mAttrs.mWindowTransitionState == LayoutParams::WINDOW_TRANSITION_ENABLE) {
                 mAnimRunning = true;
+                mService->getRootContainer()->wakeUp();
                 mWinAnimator->startAnimation(mService->getAnimConfig(false, this),
                                              [this](WindowAnimStatus status) {
                                                  this->onAnimationFinished(status);
@@ -193,8 +227,26 @@ std::shared_ptr<SurfaceControl> WindowState::createSurfaceControl(const std::vec
     return mSurfaceControl;
 }
 
-void WindowState::destroySurfaceControl() {
+std::shared_ptr<SurfaceControl> WindowState::attachSurfaceControl(
+        const std::shared_ptr<SurfaceControl>& sc) {
+    WM_PROFILER_BEGIN();
+
+    destroySurfaceControl();
+    setHasSurface(false);
+
+    sp<IBinder> handle = sp<BBinder>::make();
+    sc->rebind(IInterface::asBinder(mClient), handle, mAttrs.mWidth, mAttrs.mHeight);
+    mSurfaceControl = sc;
+
+    setHasSurface(true);
+    WM_PROFILER_END();
+
+    return mSurfaceControl;
+}
+
+std::shared_ptr<SurfaceControl> WindowState::detachSurfaceControl() {
     FLOGI("%p", this);
+    std::shared_ptr<SurfaceControl> sc;
     if (mHasSurface) {
         setHasSurface(false);
         if (mNode != nullptr) {
@@ -204,35 +256,116 @@ void WindowState::destroySurfaceControl() {
             mFrameWaiting = true;
 #endif
         }
-        uninitSurfaceBuffer(mSurfaceControl);
+        sc = mSurfaceControl;
         mSurfaceControl.reset();
     }
+    return sc;
+}
+
+void WindowState::destroySurfaceControl() {
+    auto sc = detachSurfaceControl();
+    if (sc) {
+        uninitSurfaceBuffer(sc, true);
+    }
+}
+
+bool WindowState::isSurfaceReusable(const LayoutParams& attrs) {
+    if (!mHasSurface || mSurfaceControl == nullptr || !mSurfaceControl->isValid()) {
+        return false;
+    }
+
+    return attrs.mWidth == mAttrs.mWidth && attrs.mHeight == mAttrs.mHeight &&
+            attrs.mFormat == mAttrs.mFormat;
+}
+
+bool WindowState::updateSurfaceBuffers(const std::vector<BufferId>& ids) {
+    std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
+    if (!mHasSurface || consumer == nullptr) {
+        return false;
+    }
+
+    mSurfaceControl->updateBufferIds(ids, true);
+    consumer->update(mSurfaceControl);
+    return true;
+}
+
+bool WindowState::dropFreeBuffer() {
+    std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
+    if (!mHasSurface || consumer == nullptr || mSurfaceControl->bufferIds().size() <= 2) {
+        return false;
+    }
+
+    /* only a buffer free on the server can be removed */
+    std::vector<BufferId> ids = mSurfaceControl->bufferIds();
+    BufferKey key = consumer->getFreeKey();
+    auto it = std::find_if(ids.begin(), ids.end(),
+                           [key](const BufferId& id) { return id.mKey == key; });
+    if (it == ids.end()) {
+        return false;
+    }
+
+    FLOGI("%p [%d] drop bufKey=%" PRId32 "", this, mToken->getClientPid(), key);
+    ids.erase(it);
+    return updateSurfaceBuffers(ids);
 }
 
-void WindowState::applyTransaction(LayerState layerState) {
+void WindowState::queueTransaction(const LayerState& layerState) {
     FLOGD("%p [%d] seq=%" PRIu32 "", this, mToken->getClientPid(), layerState.mSeq);
+
+    if (mPendingStates.empty()) mService->addPendingWindow(this);
+    mPendingStates.push_back(layerState);
+}
+
+bool WindowState::latchTransaction() {
+    if (mPendingStates.empty()) {
+        return false;
+    }
     WM_PROFILER_BEGIN();
 
     BufferItem* buffItem = nullptr;
-    Rect* rect = nullptr;
-    if (layerState.mFlags & LayerState::LAYER_POSITION_CHANGED) {
-    }
+    bool bufferChanged = false;
+    bool fullDamage = false;
+    Region damage;
+    uint32_t seq = 0;
+    std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
 
-    if (layerState.mFlags & LayerState::LAYER_ALPHA_CHANGED) {
-    }
+    /* all queued states of the frame collapse into the latest one */
+    for (const auto& layerState : mPendingStates) {
+        seq = layerState.mSeq;
+        if (!(layerState.mFlags & LayerState::LAYER_BUFFER_CHANGED)) {
+            continue;
+        }
+
+        bufferChanged = true;
+        BufferItem* item =
+                consumer != nullptr ? consumer->syncQueuedState(layerState.mBufferKey) : nullptr;
+        if (item == nullptr) {
+            /* buffer was removed from surface while the transaction was in flight */
+            FLOGW("%p invalid bufKey=%" PRId32 "", this, layerState.mBufferKey);
+            continue;
+        }
 
-    if (layerState.mFlags & LayerState::LAYER_BUFFER_CHANGED) {
-        std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
-        if (consumer == nullptr) {
-            WM_PROFILER_END();
-            return;
+        /* never shown, give it back before the newer one takes its place */
+        if (buffItem && buffItem != item) {
+            FLOGD("%p drop pending bufKey=%" PRId32 "", this, buffItem->mKey);
+            releaseBuffer(buffItem);
+        }
+        buffItem = item;
+
+        if (layerState.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED) {
+            damage.orSelf(layerState.mBufferCrop);
+        } else {
+            fullDamage = true;
         }
-        buffItem = consumer->syncQueuedState(layerState.mBufferKey);
     }
+    mPendingStates.clear();
 
-    if (layerState.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED) {
-        rect = &layerState.mBufferCrop;
+    if (bufferChanged && buffItem == nullptr) {
+        WM_PROFILER_END();
+        return false;
     }
+
+    Region* rect = (fullDamage || damage.isEmpty()) ? nullptr : &damage;
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     if (mFrameWaiting &&
         (mAttrs.mWindowTransitionState == LayoutParams::WINDOW_TRANSITION_ENABLE)) {
@@ -251,44 +384,65 @@ void WindowState::applyTransaction(LayerState layerState) {
     if (mAnimRunning && (buffItem == nullptr)) {
         FLOGW("%p [%d] animation is running, drop the null buffer data", this,
               mToken->getClientPid());
-        return;
+        WM_PROFILER_END();
+        return false;
     }
 
 #endif
 
-    mNode->updateBuffer(buffItem, rect, layerState.mSeq);
+    bool result = mNode->updateBuffer(buffItem, rect, seq);
     WM_PROFILER_END();
+    return result;
 }
 
 bool WindowState::scheduleVsync(VsyncRequest vsyncReq) {
-    mService->getRootContainer()->enableVsync(true);
+    if (vsyncReq != VsyncRequest::VSYNC_REQ_NONE) {
+        auto container = mService->getRootContainer();
+        container->enableVsync(true);
+        /* a faster request can't wait for the divided timer */
+        container->setVsyncDivisor(vsyncGcd(container->getVsyncDivisor(), vsyncDivisor(vsyncReq)));
+    }
 
     if (mVsyncRequest == vsyncReq) {
         return false;
     }
 
     /* observer for animation */
-    if (vsyncReq == VsyncRequest::VSYNC_REQ_PERIODIC ||
-        mVsyncRequest == VsyncRequest::VSYNC_REQ_PERIODIC)
+    if (isPeriodicVsync(vsyncReq) || isPeriodicVsync(mVsyncRequest))
         FLOGW("%p [%d] request vreq=%s", this, mToken->getClientPid(),
               VsyncRequestToString(vsyncReq));
 
-    mVsyncRequest = vsyncReq;
+    setVsyncRequest(vsyncReq);
 
     return true;
 }
 
-VsyncRequest WindowState::onVsync() {
-    if (mVsyncRequest == VsyncRequest::VSYNC_REQ_NONE) {
+void WindowState::setVsyncRequest(VsyncRequest vsyncReq) {
+    mVsyncRequest = vsyncReq;
+    if (mVsyncRequest != VsyncRequest::VSYNC_REQ_NONE) {
+        mService->addVsyncWindow(this);
+    } else {
+        mService->removeVsyncWindow(this);
+    }
+}
+
+VsyncRequest WindowState::onVsync(uint32_t tick, bool broadcast, const FrameTimeline& timeline) {
+    /* not a tick of its rate */
+    if (!vsyncDueAt(mVsyncRequest, tick)) {
         return mVsyncRequest;
     }
     WM_PROFILER_BEGIN();
 
-    mVsyncRequest = nextVsyncState(mVsyncRequest);
-    mClient->onFrame(++mFrameReq);
+    mVsyncDeferred = false;
+    setVsyncRequest(nextVsyncState(mVsyncRequest));
+    /* a subscribed process is woken by its vsync channel */
+    if (!broadcast) {
+        mClient->onFrame(++mFrameReq, timeline.mVsyncTime, timeline.mExpectedPresentTime,
+                         timeline.mDeadline);
+    }
 
-    FLOGI("%p [%d] vreq=%s send vsync(seq=%" PRIu32 ") to client!", this, mToken->getClientPid(),
-          VsyncRequestToString(mVsyncRequest), mFrameReq);
+    FLOGI("%p [%d] vreq=%s %s vsync(seq=%" PRIu32 ") to client!", this, mToken->getClientPid(),
+          VsyncRequestToString(mVsyncRequest), broadcast ? "broadcast" : "send", mFrameReq);
 
     if (mFrameReq == UINT32_MAX) mFrameReq = 0;
 
@@ -297,6 +451,23 @@ VsyncRequest WindowState::onVsync() {
     return mVsyncRequest;
 }
 
+int32_t WindowState::getVsyncPriority() {
+    if (!isVisible()) return VSYNC_PRIORITY_INVISIBLE;
+
+    int32_t priority = getLayerPriority(mToken->getType());
+    if (mService->getFocusedWindow() == this) priority += VSYNC_PRIORITY_FOCUSED;
+    return priority;
+}
+
+bool WindowState::deferVsync() {
+    /* never twice in a row, and rate divided requests are only due on their own ticks */
+    if (mVsyncDeferred || vsyncDivisor(mVsyncRequest) > 1) return false;
+
+    mVsyncDeferred = true;
+    FLOGD("%p [%d] vsync deferred", this, mToken->getClientPid());
+    return true;
+}
+
 void WindowState::removeIfPossible() {
     mFlags |= WS_ALLOW_REMOVING;
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
@@ -345,7 +516,7 @@ bool WindowState::releaseBuffer(BufferItem* buffer) {
         WM_PROFILER_BEGIN();
 
         if (!mSurfaceControl->getFMQ().write(&(buffer->mKey))) {
-            FLOGE("%p Failed to relase bufKey=%" PRId32 "", this, buffer->mKey);
+            FLOGW("%p fmq is full, relase bufKey=%" PRId32 " by binder", this, buffer->mKey);
             /* fallback non-fmq */
             mClient->bufferReleased(buffer->mKey);
         } else {
@@ -358,7 +529,7 @@ bool WindowState::releaseBuffer(BufferItem* buffer) {
 }
 
 void WindowState::setLayoutParams(LayoutParams attrs) {
-    if (mSurfaceControl != nullptr && mSurfaceControl->isValid()) {
+    if (mSurfaceControl != nullptr && mSurfaceControl->isValid() && !isSurfaceReusable(attrs)) {
         FLOGW("%p shouldn't update layout configuration when surface is valid!", this);
         return;
     }
@@ -372,6 +543,13 @@ uint32_t WindowState::getSurfaceSize() {
     return mNode->getSurfaceSize();
 }
 
+uint32_t WindowState::getSurfaceBytes() {
+    if (!mHasSurface || mSurfaceControl == nullptr || !mSurfaceControl->isValid()) {
+        return 0;
+    }
+    return mSurfaceControl->bufferIds().size() * mSurfaceControl->getBufferSize();
+}
+
 bool WindowState::isVisible() {
     return mVisibility != LayoutParams::WINDOW_GONE ? true : false;
 }
@@ -59,13 +59,47 @@ public:
     std::shared_ptr<InputDispatcher> createInputDispatcher(const std::string& name);
     std::shared_ptr<SurfaceControl> createSurfaceControl(const std::vector<BufferId>& ids,
                                                          const std::string& fmqName);
+    std::shared_ptr<SurfaceControl> attachSurfaceControl(const std::shared_ptr<SurfaceControl>& sc);
+    std::shared_ptr<SurfaceControl> detachSurfaceControl();
     std::shared_ptr<BufferConsumer> getBufferConsumer();
     void destroySurfaceControl();
+    bool isSurfaceReusable(const LayoutParams& attrs);
+    bool updateSurfaceBuffers(const std::vector<BufferId>& ids);
+    // remove one buffer which is free on the server, down to double buffering, only on
+    // request of the client which drops it at the same time
+    bool dropFreeBuffer();
+
+    std::shared_ptr<SurfaceControl> getSurfaceControl() {
+        return mSurfaceControl;
+    }
 
-    void applyTransaction(LayerState layerState);
+    // queued until the next composition latches them, see latchTransaction
+    void queueTransaction(const LayerState& layerState);
+    bool latchTransaction();
     bool scheduleVsync(VsyncRequest vsyncReq);
-    VsyncRequest onVsync();
+    VsyncRequest onVsync(uint32_t tick, bool broadcast, const FrameTimeline& timeline);
+    int32_t getVsyncIndex() {
+        return mVsyncIndex;
+    }
+    void setVsyncIndex(int32_t index) {
+        mVsyncIndex = index;
+    }
+    bool isVsyncDue(uint32_t tick) {
+        return vsyncDueAt(mVsyncRequest, tick);
+    }
+    // focused window first, then by layer from top to bottom
+    int32_t getVsyncPriority();
+    // skips a single tick, the window is served on the next one
+    bool deferVsync();
+    bool isVsyncDeferred() {
+        return mVsyncDeferred;
+    }
     bool sendInputMessage(const InputMessage* ie);
+#ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
+    bool isAnimating() {
+        return mAnimRunning;
+    }
+#endif
 
     std::shared_ptr<WindowToken> getToken() {
         return mToken;
@@ -79,11 +113,24 @@ public:
         mHasSurface = hasSurface;
     }
 
+    void setClientPid(int32_t pid) {
+        mClientPid = pid;
+    }
+
+    int32_t getClientPid() {
+        return mClientPid;
+    }
+
+    LayoutParams& getLayoutParams() {
+        return mAttrs;
+    }
+
     BufferItem* acquireBuffer();
     bool releaseBuffer(BufferItem* buffer);
 
     void setLayoutParams(LayoutParams attrs);
     uint32_t getSurfaceSize();
+    uint32_t getSurfaceBytes();
 
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     void onAnimationFinished(WindowAnimStatus status);
@@ -92,13 +139,19 @@ public:
     DISALLOW_COPY_AND_ASSIGN(WindowState);
 
 private:
+    void setVsyncRequest(VsyncRequest vsyncReq);
+
     sp<IWindow> mClient;
     std::shared_ptr<WindowToken> mToken;
     WindowManagerService* mService;
     std::shared_ptr<SurfaceControl> mSurfaceControl;
     std::shared_ptr<InputDispatcher> mInputDispatcher;
     LayoutParams mAttrs;
+    std::vector<LayerState> mPendingStates;
     VsyncRequest mVsyncRequest;
+    /* slot in the vsync window set of the service, -1 for none */
+    int32_t mVsyncIndex;
+    bool mVsyncDeferred;
     uint32_t mFrameReq;
     int32_t mVisibility;
     bool mHasSurface;
@@ -114,6 +167,7 @@ private:
     };
     int32_t mFlags;
     bool mNeedInput;
+    int32_t mClientPid;
 };
 
 } // namespace wm
@@ -73,6 +73,14 @@ void WindowToken::setClientVisibility(int32_t visibility) {
     }
 }
 
+uint32_t WindowToken::getSurfaceBytes() {
+    uint32_t bytes = 0;
+    for (auto it = mChildren.begin(); it != mChildren.end(); it++) {
+        bytes += (*it)->getSurfaceBytes();
+    }
+    return bytes;
+}
+
 void WindowToken::removeIfPossible() {
     if (mRemoved) return;
     mRemoved = true;
@@ -61,6 +61,9 @@ public:
         return mPersistOnEmpty;
     }
 
+    /* shared memory held by the surfaces of this token's windows */
+    uint32_t getSurfaceBytes();
+
     void removeIfPossible();
     int32_t getType() {
         return mType;
@@ -98,7 +98,8 @@ lv_obj_t* lv_mainwnd_create(lv_obj_t* parent) {
     return obj;
 }
 
-bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* area) {
+bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* areas,
+                              uint32_t count) {
     LV_ASSERT_OBJ(obj, MY_CLASS);
     WM_PROFILER_BEGIN();
 
@@ -129,7 +130,7 @@ bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, cons
     mainwnd->buf_dsc.img_dsc.header.w = buf_dsc->img_dsc.header.w;
     mainwnd->buf_dsc.img_dsc.header.h = buf_dsc->img_dsc.header.h;
 
-    if (!area) {
+    if (!areas) {
         lv_obj_invalidate(obj);
         WM_PROFILER_END();
         return true;
@@ -138,12 +139,16 @@ bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, cons
     lv_area_t win_coords;
     lv_obj_get_coords(obj, &win_coords);
 
-    if (win_coords.x1 != 0 || win_coords.y1 != 0)
-        lv_area_move((lv_area_t*)area, win_coords.x1, win_coords.y1);
+    /* invalidate every damaged area, not their bounding box */
+    for (uint32_t i = 0; i < count; i++) {
+        lv_area_t area = areas[i];
+        if (win_coords.x1 != 0 || win_coords.y1 != 0)
+            lv_area_move(&area, win_coords.x1, win_coords.y1);
 
-    lv_area_t inv_area;
-    if (_lv_area_intersect(&inv_area, &win_coords, area)) {
-        lv_obj_invalidate_area(obj, &inv_area);
+        lv_area_t inv_area;
+        if (_lv_area_intersect(&inv_area, &win_coords, &area)) {
+            lv_obj_invalidate_area(obj, &inv_area);
+        }
     }
     WM_PROFILER_END();
     return true;
@@ -268,6 +273,7 @@ static inline void dump_input_event(lv_mainwnd_input_event_t* ie) {
 static inline void send_input_event(lv_mainwnd_t* mainwnd, lv_event_code_t code,
                                     lv_indev_t* indev) {
     lv_mainwnd_input_event_t ie;
+    lv_memzero(&ie, sizeof(ie));
     ie.type = lv_indev_get_type(indev);
     LV_LOG_TRACE("mainwnd %p, code %d", mainwnd, code);
 
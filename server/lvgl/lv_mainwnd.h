@@ -102,10 +102,12 @@ lv_obj_t* lv_mainwnd_create(lv_obj_t* parent);
  * Update buffer.
  * @param obj           pointer to a main window object
  * @param buf_dsc       pointer to the buffer descriptor
- * @param area          pointer to an area to update
+ * @param areas         pointer to the areas to update, NULL to update the whole window
+ * @param count         number of areas
  * @return true on success, false on failure
  */
-bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* area);
+bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* areas,
+                              uint32_t count);
 
 /**
  * Update flag.
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/WindowUtils.h"
+#include "wm/BufferQueue.h"
+#include "wm/SurfaceControl.h"
+
+namespace os {
+namespace wm {
+
+/* a 466x466 ARGB8888 surface, double buffered */
+#define BENCH_BUFFER_SIZE (466 * 466 * 4)
+#define BENCH_BUFFER_COUNT 2
+#define BENCH_LOOPS 50
+#define BENCH_ROUND_TRIPS 10000
+#define BENCH_FMQ_OPS 100000
+#define BENCH_UPDATE_LOOPS 200
+
+#if defined(CONFIG_ENABLE_BUFFER_QUEUE_BY_MEMFD)
+#define BENCH_BACKEND "memfd"
+#elif defined(CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME)
+#define BENCH_BACKEND "name"
+#else
+#define BENCH_BACKEND "shm"
+#endif
+
+typedef struct {
+    int32_t mWidth;
+    int32_t mHeight;
+} BenchResolution;
+
+static const BenchResolution kResolutions[] = {{240, 240}, {466, 466}, {800, 480}};
+static const uint32_t kBufferCounts[] = {2, 3, BUFFER_QUEUE_MAX_SLOTS};
+
+/*
+ * Results are printed as one json object per line with a "BENCH " prefix,
+ * e.g. `BufferQueueBenchmark | grep ^BENCH | cut -c7-` gives json lines.
+ */
+class BenchReport {
+public:
+    BenchReport(const char* name) {
+        mJson = std::string("{\"bench\":\"") + name + "\",\"backend\":\"" BENCH_BACKEND "\"";
+    }
+
+    BenchReport& add(const char* key, uint64_t value) {
+        mJson += std::string(",\"") + key + "\":" + std::to_string(value);
+        return *this;
+    }
+
+    ~BenchReport() {
+        printf("BENCH %s}\n", mJson.c_str());
+    }
+
+private:
+    std::string mJson;
+};
+
+static inline uint64_t perSecond(uint64_t count, uint64_t us) {
+    return us > 0 ? count * 1000000 / us : 0;
+}
+
+static std::string benchName(const char* prefix, int32_t loop, int32_t index) {
+    return std::string("xms:") + prefix + "-" + std::to_string(getpid()) + "-" +
+            std::to_string(loop) + "-" + std::to_string(index);
+}
+
+static std::shared_ptr<SurfaceControl> createBenchSurface(const char* prefix, BufferKey keyBase,
+                                                          int32_t width, int32_t height,
+                                                          uint32_t count) {
+    std::vector<BufferId> ids;
+    for (uint32_t i = 0; i < count; i++) {
+        ids.push_back({benchName(prefix, width, i), keyBase + (BufferKey)i + 1, -1});
+    }
+
+    auto sc = std::make_shared<SurfaceControl>(nullptr, nullptr, width, height, 0,
+                                               width * height * 4);
+    sc->getFMQ().setName(benchName(prefix, width, -1));
+    sc->initBufferIds(ids);
+    initSurfaceBuffer(sc, true);
+    return sc;
+}
+
+/* the view a client gets, every fd is its own dup as if passed by binder */
+static std::shared_ptr<SurfaceControl> dupBenchSurface(const std::shared_ptr<SurfaceControl>& sc) {
+    std::vector<BufferId> ids;
+    for (const auto& id : sc->bufferIds()) {
+        ids.push_back({id.mName, id.mKey, dup(id.mFd)});
+    }
+
+    auto client = std::make_shared<SurfaceControl>(nullptr, nullptr, sc->getWidth(),
+                                                   sc->getHeight(), 0, sc->getBufferSize());
+    client->initBufferIds(ids);
+    return client;
+}
+
+static void destroyBenchSurface(const std::shared_ptr<SurfaceControl>& sc) {
+    for (const auto& id : sc->bufferIds()) {
+        close(id.mFd);
+    }
+    uninitSurfaceBuffer(sc, true);
+}
+
+/* baseline: what the named backend does for every buffer */
+static void createNamedSurface(int32_t loop) {
+    for (int32_t i = 0; i < BENCH_BUFFER_COUNT; i++) {
+        std::string name = benchName("bench", loop, i);
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        ASSERT_NE(fd, -1);
+        ASSERT_NE(ftruncate(fd, BENCH_BUFFER_SIZE), -1);
+
+        void* buffer = mmap(nullptr, BENCH_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ASSERT_NE(buffer, MAP_FAILED);
+        munmap(buffer, BENCH_BUFFER_SIZE);
+        close(fd);
+        shm_unlink(name.c_str());
+    }
+}
+
+/* the configured backend, through the same calls as the service */
+static void createSurface(int32_t loop) {
+    std::vector<BufferId> ids;
+    for (int32_t i = 0; i < BENCH_BUFFER_COUNT; i++) {
+        ids.push_back({benchName("bq", loop, i), i + 1, -1});
+    }
+
+    auto sc = std::make_shared<SurfaceControl>(nullptr, nullptr, 466, 466, 0, BENCH_BUFFER_SIZE);
+    sc->initBufferIds(ids);
+    initSurfaceBuffer(sc, true);
+    ASSERT_EQ(sc->bufferIds().size(), (size_t)BENCH_BUFFER_COUNT);
+
+    auto consumer = std::make_shared<BufferConsumer>(sc);
+    EXPECT_EQ(consumer->getBufferCount(), (uint32_t)BENCH_BUFFER_COUNT);
+    sc->setBufferQueue(consumer);
+
+    uninitSurfaceBuffer(sc, true);
+    sc->setBufferQueue(nullptr);
+}
+
+TEST(BufferQueueBenchmark, SurfaceCreation) {
+    uint64_t start = curSysTimeUs();
+    for (int32_t i = 0; i < BENCH_LOOPS; i++) {
+        createNamedSurface(i);
+    }
+    uint64_t namedUs = (curSysTimeUs() - start) / BENCH_LOOPS;
+
+    start = curSysTimeUs();
+    for (int32_t i = 0; i < BENCH_LOOPS; i++) {
+        createSurface(i);
+    }
+    uint64_t surfaceUs = (curSysTimeUs() - start) / BENCH_LOOPS;
+
+    BenchReport("SurfaceCreation").add("namedUs", namedUs).add("surfaceUs", surfaceUs);
+}
+
+/* dequeue -> queue -> acquire -> release, as one frame goes through both sides */
+TEST(BufferQueueBenchmark, RoundTrip) {
+    for (const auto& res : kResolutions) {
+        auto sc = createBenchSurface("rt", 0, res.mWidth, res.mHeight, BENCH_BUFFER_COUNT);
+        ASSERT_EQ(sc->bufferIds().size(), (size_t)BENCH_BUFFER_COUNT);
+
+        auto producer = std::make_shared<BufferProducer>(dupBenchSurface(sc));
+        auto consumer = std::make_shared<BufferConsumer>(dupBenchSurface(sc));
+
+        int32_t failed = 0;
+        uint64_t start = 0;
+        /* the first loops map the buffers, leave them out */
+        for (int32_t i = -BENCH_BUFFER_COUNT; i < BENCH_ROUND_TRIPS; i++) {
+            if (i == 0) start = curSysTimeUs();
+
+            BufferItem* buffer = producer->dequeueBuffer();
+            if (!buffer || !producer->queueBuffer(buffer) ||
+                !consumer->syncQueuedState(buffer->mKey)) {
+                failed++;
+                continue;
+            }
+
+            BufferItem* acquired = consumer->acquireBuffer();
+            if (!acquired || !consumer->releaseBuffer(acquired) ||
+                !producer->syncFreeState(acquired->mKey)) {
+                failed++;
+            }
+        }
+        uint64_t us = curSysTimeUs() - start;
+        EXPECT_EQ(failed, 0);
+
+        BenchReport("RoundTrip")
+                .add("width", res.mWidth)
+                .add("height", res.mHeight)
+                .add("loops", BENCH_ROUND_TRIPS)
+                .add("totalUs", us)
+                .add("perSec", perSecond(BENCH_ROUND_TRIPS, us));
+
+        producer.reset();
+        consumer.reset();
+        destroyBenchSurface(sc);
+    }
+}
+
+TEST(BufferQueueBenchmark, FmqThroughput) {
+    std::vector<BufferKey> keys = {1, 2};
+    FakeFmq<BufferKey> fmq;
+    fmq.setName(benchName("fmq", 0, 0));
+    ASSERT_TRUE(fmq.create(keys, true));
+
+    BufferKey key = 0;
+    BufferKey batch[BUFFER_QUEUE_MAX_SLOTS];
+    uint32_t caps = fmq.capacity();
+    while (fmq.read(&key)) {
+    }
+
+    /* fill the ring and drain it, single reads */
+    int32_t failed = 0;
+    uint64_t start = curSysTimeUs();
+    for (uint32_t n = 0; n < BENCH_FMQ_OPS; n += caps) {
+        for (uint32_t i = 0; i < caps; i++) {
+            if (!fmq.write(&keys[i & 1])) failed++;
+        }
+        for (uint32_t i = 0; i < caps; i++) {
+            if (!fmq.read(&key)) failed++;
+        }
+    }
+    uint64_t singleUs = curSysTimeUs() - start;
+
+    /* the same with batch reads, as the client drains the fmq */
+    start = curSysTimeUs();
+    for (uint32_t n = 0; n < BENCH_FMQ_OPS; n += caps) {
+        for (uint32_t i = 0; i < caps; i++) {
+            if (!fmq.write(&keys[i & 1])) failed++;
+        }
+        for (uint32_t read = 0; read < caps;) {
+            uint32_t count = fmq.readBatch(batch, DATA_MIN(caps - read, BUFFER_QUEUE_MAX_SLOTS));
+            if (count == 0) {
+                failed++;
+                break;
+            }
+            read += count;
+        }
+    }
+    uint64_t batchUs = curSysTimeUs() - start;
+    EXPECT_EQ(failed, 0);
+
+    BenchReport("FmqThroughput")
+            .add("capacity", caps)
+            .add("ops", BENCH_FMQ_OPS)
+            .add("singleUs", singleUs)
+            .add("singlePerSec", perSecond(BENCH_FMQ_OPS, singleUs))
+            .add("batchUs", batchUs)
+            .add("batchPerSec", perSecond(BENCH_FMQ_OPS, batchUs));
+
+    fmq.destroy();
+}
+
+/*
+ * Swap all buffer ids of a queue, every buffer is dropped and mapped again.
+ * The fds are duplicated inside the loop, as binder does for each update.
+ */
+TEST(BufferQueueBenchmark, UpdateRemap) {
+    for (const auto& res : kResolutions) {
+        for (uint32_t count : kBufferCounts) {
+            auto sc1 = createBenchSurface("ua", 100, res.mWidth, res.mHeight, count);
+            auto sc2 = createBenchSurface("ub", 200, res.mWidth, res.mHeight, count);
+            ASSERT_EQ(sc1->bufferIds().size(), count);
+            ASSERT_EQ(sc2->bufferIds().size(), count);
+
+            auto producer = std::make_shared<BufferProducer>(dupBenchSurface(sc1));
+            BufferItem* items[BUFFER_QUEUE_MAX_SLOTS];
+
+            int32_t failed = 0;
+            uint64_t start = curSysTimeUs();
+            for (int32_t i = 0; i < BENCH_UPDATE_LOOPS; i++) {
+                if (!producer->update(dupBenchSurface((i & 1) ? sc1 : sc2))) failed++;
+
+                /* dequeue maps a buffer on first use */
+                for (uint32_t j = 0; j < count; j++) {
+                    items[j] = producer->dequeueBuffer();
+                    if (!items[j]) failed++;
+                }
+                for (uint32_t j = 0; j < count; j++) {
+                    if (items[j]) producer->cancelBuffer(items[j]);
+                }
+            }
+            uint64_t us = curSysTimeUs() - start;
+            EXPECT_EQ(failed, 0);
+
+            BenchReport("UpdateRemap")
+                    .add("width", res.mWidth)
+                    .add("height", res.mHeight)
+                    .add("buffers", count)
+                    .add("loops", BENCH_UPDATE_LOOPS)
+                    .add("updateUs", us / BENCH_UPDATE_LOOPS);
+
+            producer.reset();
+            destroyBenchSurface(sc1);
+            destroyBenchSurface(sc2);
+        }
+    }
+}
+
+extern "C" int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os
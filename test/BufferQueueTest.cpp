@@ -15,9 +15,11 @@
  */
 
 #include <gtest/gtest.h>
+#include <malloc.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "wm/BufferQueue.h"
@@ -51,10 +53,10 @@ protected:
         mIdsProducer.push_back(id1);
         mIdsProducer.push_back(id2);
 
-        mSCConsumer = std::make_shared<SurfaceControl>();
+        mSCConsumer = std::make_shared<SurfaceControl>(nullptr, nullptr, 0, 0, 0, 20);
         mSCConsumer->initBufferIds(mIdsConsumer);
 
-        mSCProducer = std::make_shared<SurfaceControl>();
+        mSCProducer = std::make_shared<SurfaceControl>(nullptr, nullptr, 0, 0, 0, 20);
         mSCProducer->initBufferIds(mIdsProducer);
     } // namespace wm
     void TearDown() override {}
@@ -96,6 +98,169 @@ TEST_F(BufferQueueTest, AcquiredReleaseBuffer) {
     EXPECT_EQ(buffConsumer->releaseBuffer(buffer2), true);
 }
 
+TEST_F(BufferQueueTest, NoAllocationAfterUpdate) {
+    std::shared_ptr<BufferConsumer> buffConsumer = std::make_shared<BufferConsumer>(mSCConsumer);
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+
+    int32_t failed = 0;
+    struct mallinfo before = mallinfo();
+    for (int i = 0; i < 100; i++) {
+        BufferItem* buffer = buffProducer->dequeueBuffer();
+        if (!buffer || !buffProducer->queueBuffer(buffer)) failed++;
+        if (!buffer || !buffConsumer->syncQueuedState(buffer->mKey)) failed++;
+
+        BufferItem* buffer2 = buffConsumer->acquireBuffer();
+        if (!buffer2 || !buffConsumer->releaseBuffer(buffer2)) failed++;
+        if (!buffer2 || !buffProducer->syncFreeState(buffer2->mKey)) failed++;
+
+        buffer = buffProducer->dequeueBuffer();
+        if (!buffer || !buffProducer->cancelBuffer(buffer)) failed++;
+    }
+    struct mallinfo after = mallinfo();
+
+    EXPECT_EQ(failed, 0);
+    EXPECT_EQ(after.uordblks, before.uordblks);
+}
+
+TEST_F(BufferQueueTest, FifoOrder) {
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    BufferItem* buffer2 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer1, nullptr);
+    ASSERT_NE(buffer2, nullptr);
+    EXPECT_EQ(buffProducer->dequeueBuffer(), nullptr);
+
+    // buffers come back in the order they were released
+    EXPECT_TRUE(buffProducer->cancelBuffer(buffer2));
+    EXPECT_TRUE(buffProducer->cancelBuffer(buffer1));
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer2);
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer1);
+    EXPECT_FALSE(buffProducer->cancelBuffer(nullptr));
+}
+
+TEST_F(BufferQueueTest, UpdateBufferCount) {
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer1, nullptr);
+
+    // grow on the same surface keeps the dequeued buffer
+    int fd3 = shm_open("testBuffer3", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(fd3, 20);
+    std::vector<BufferId> ids = mSCProducer->bufferIds();
+    ids.push_back({"testBuffer3", 3, fd3});
+    mSCProducer->updateBufferIds(ids, false);
+    EXPECT_TRUE(buffProducer->update(mSCProducer));
+    EXPECT_EQ(buffProducer->getBufferCount(), 3u);
+    EXPECT_EQ(buffProducer->getBufferByKey(buffer1->mKey), buffer1);
+
+    // shrink removes a free buffer only
+    BufferKey freeKey = buffProducer->getFreeKey();
+    ASSERT_NE(freeKey, -1);
+    EXPECT_NE(freeKey, buffer1->mKey);
+    ids.erase(std::find_if(ids.begin(), ids.end(),
+                           [freeKey](const BufferId& id) { return id.mKey == freeKey; }));
+    mSCProducer->updateBufferIds(ids, false);
+    EXPECT_TRUE(buffProducer->update(mSCProducer));
+    EXPECT_EQ(buffProducer->getBufferCount(), 2u);
+    EXPECT_EQ(buffProducer->getBufferByKey(freeKey), nullptr);
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer1));
+    shm_unlink("testBuffer3");
+}
+
+TEST_F(BufferQueueTest, RemoveBufferInUse) {
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+    std::shared_ptr<BufferConsumer> buffConsumer = std::make_shared<BufferConsumer>(mSCConsumer);
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer1, nullptr);
+    BufferKey key1 = buffer1->mKey;
+    ASSERT_NE(buffConsumer->syncQueuedState(key1), nullptr);
+    BufferItem* acquired = buffConsumer->acquireBuffer();
+    ASSERT_NE(acquired, nullptr);
+    EXPECT_EQ(acquired->mKey, key1);
+
+    std::vector<BufferId> ids;
+    for (const auto& id : mIdsProducer) {
+        if (id.mKey != key1) ids.push_back(id);
+    }
+
+    // dequeued buffer is kept until the producer gives it back
+    mSCProducer->updateBufferIds(ids, false);
+    buffProducer->update(mSCProducer);
+    EXPECT_EQ(buffProducer->getBufferByKey(key1), buffer1);
+    EXPECT_FALSE(buffProducer->queueBuffer(buffer1));
+    EXPECT_EQ(buffProducer->getBufferByKey(key1), nullptr);
+    EXPECT_EQ(buffProducer->getBufferCount(), 1u);
+
+    // acquired buffer is kept until the consumer releases it
+    mSCConsumer->updateBufferIds(ids, false);
+    buffConsumer->update(mSCConsumer);
+    EXPECT_EQ(buffConsumer->getBufferByKey(key1), acquired);
+    EXPECT_TRUE(buffConsumer->releaseBuffer(acquired));
+    EXPECT_EQ(buffConsumer->getBufferByKey(key1), nullptr);
+    EXPECT_EQ(buffConsumer->getBufferCount(), 1u);
+}
+
+TEST_F(BufferQueueTest, BufferAge) {
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer1, nullptr);
+    EXPECT_EQ(buffer1->mAge, 0u);
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer1));
+    EXPECT_EQ(buffer1->mAge, 1u);
+
+    // an undrawn buffer stays undefined, a cancelled one keeps its age
+    BufferItem* buffer2 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer2, nullptr);
+    EXPECT_EQ(buffer2->mAge, 0u);
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer2));
+    EXPECT_EQ(buffer1->mAge, 2u);
+    EXPECT_EQ(buffer2->mAge, 1u);
+
+    EXPECT_NE(buffProducer->syncFreeState(buffer1->mKey), nullptr);
+    buffer1 = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer1, nullptr);
+    EXPECT_TRUE(buffProducer->cancelBuffer(buffer1));
+    EXPECT_EQ(buffer1->mAge, 2u);
+}
+
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_LAZY_ALLOC
+TEST_F(BufferQueueTest, LazyMapping) {
+    int fd3 = shm_open("testBuffer3", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    int fd4 = shm_open("testBuffer4", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    auto sc = std::make_shared<SurfaceControl>(nullptr, nullptr, 0, 0, 0, 20);
+    sc->initBufferIds({{"testBuffer3", 3, fd3}, {"testBuffer4", 4, fd4}});
+
+    // nothing is mapped or sized before the first dequeue
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(sc);
+    EXPECT_EQ(buffProducer->getBufferByKey(3)->mBuffer, nullptr);
+    EXPECT_EQ(buffProducer->getBufferByKey(4)->mBuffer, nullptr);
+
+    BufferItem* buffer = buffProducer->dequeueBuffer();
+    ASSERT_NE(buffer, nullptr);
+    EXPECT_NE(buffer->mBuffer, nullptr);
+
+    struct stat st;
+    EXPECT_EQ(fstat(buffer->mFd, &st), 0);
+    EXPECT_GE(st.st_size, 20);
+
+    // the other free buffer is sized and mapped ahead of its dequeue
+    BufferItem* next = buffProducer->getBufferByKey(buffer->mKey == 3 ? 4 : 3);
+    EXPECT_EQ(next->mBuffer, nullptr);
+    EXPECT_TRUE(buffProducer->prefaultBuffer());
+    ASSERT_NE(next->mBuffer, nullptr);
+    EXPECT_EQ(fstat(next->mFd, &st), 0);
+    EXPECT_GE(st.st_size, 20);
+
+    // dequeue keeps the prefaulted mapping, nothing is left to prefault
+    void* mapped = next->mBuffer;
+    EXPECT_EQ(buffProducer->dequeueBuffer(), next);
+    EXPECT_EQ(next->mBuffer, mapped);
+    EXPECT_FALSE(buffProducer->prefaultBuffer());
+    shm_unlink("testBuffer3");
+    shm_unlink("testBuffer4");
+}
+#endif
+
 extern "C" int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -15,6 +15,9 @@
  */
 
 #include <gtest/gtest.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "wm/FakeFmq.h"
 
@@ -77,6 +80,83 @@ TEST_F(FakeFmqTest, TestServerWriteClientRead) {
     ASSERT_EQ(result, mExpectedTwo);
 }
 
+TEST_F(FakeFmqTest, TestFullAndEmpty) {
+    int result = 0;
+
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_TRUE(mClientFmq.empty());
+    ASSERT_FALSE(mClientFmq.read(&result));
+
+    /* zero is a valid key */
+    int value = 0;
+    for (uint32_t i = 0; i < mServerFmq.capacity(); i++) {
+        ASSERT_TRUE(mServerFmq.write(&value));
+    }
+    ASSERT_TRUE(mServerFmq.full());
+    ASSERT_FALSE(mServerFmq.write(&value));
+
+    result = -1;
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_EQ(result, 0);
+    ASSERT_FALSE(mServerFmq.full());
+    ASSERT_TRUE(mServerFmq.write(&value));
+}
+
+TEST_F(FakeFmqTest, TestReadBatch) {
+    int results[4] = {0};
+
+    ASSERT_TRUE(mServerFmq.write(&mExpectedOne));
+    ASSERT_EQ(mClientFmq.readBatch(results, 4), 3u);
+    ASSERT_EQ(results[0], mExpectedOne);
+    ASSERT_EQ(results[1], mExpectedTwo);
+    ASSERT_EQ(results[2], mExpectedOne);
+    ASSERT_EQ(mClientFmq.readBatch(results, 4), 0u);
+    ASSERT_TRUE(mClientFmq.empty());
+}
+
+#ifdef CONFIG_ARCH_HAVE_FORK
+TEST_F(FakeFmqTest, TestTwoProcessStress) {
+    const int count = 100000;
+    int result = 0;
+
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_TRUE(mClientFmq.read(&result));
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+
+    if (pid == 0) {
+        /* consumer: keys must arrive in order without loss */
+        for (int expected = 0; expected < count;) {
+            if (!mClientFmq.read(&result)) {
+                sched_yield();
+                continue;
+            }
+            if (result != expected) {
+                _exit(1);
+            }
+            expected++;
+        }
+        _exit(0);
+    }
+
+    for (int value = 0; value < count;) {
+        if (!mServerFmq.write(&value)) {
+            sched_yield();
+            continue;
+        }
+        value++;
+    }
+
+    int status = -1;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+    ASSERT_TRUE(mServerFmq.empty());
+}
+#endif
+
 extern "C" int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
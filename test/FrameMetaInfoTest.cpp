@@ -53,6 +53,16 @@ TEST_F(FrameMetaInfoTest, TestSetVsync) {
     EXPECT_TRUE(frameMetaInfo.getSkipReason().has_value());
 }
 
+TEST_F(FrameMetaInfoTest, TestBufferRecoveredFlag) {
+    frameMetaInfo.setVsync(curSysTimeMs(), 102, 33);
+    EXPECT_FALSE(frameMetaInfo.hasFlag(FrameMetaInfoFlags::BufferRecovered));
+
+    frameMetaInfo.addFlag(FrameMetaInfoFlags::BufferRecovered);
+    EXPECT_TRUE(frameMetaInfo.hasFlag(FrameMetaInfoFlags::BufferRecovered));
+    EXPECT_TRUE(frameMetaInfo.hasFlag(FrameMetaInfoFlags::SurfaceDraw));
+    EXPECT_FALSE(frameMetaInfo.getSkipReason().has_value());
+}
+
 TEST_F(FrameMetaInfoTest, TestRenderDuration) {
     int64_t vsyncTime = curSysTimeMs();
     int64_t sleep_ms = 5;
@@ -65,6 +75,48 @@ TEST_F(FrameMetaInfoTest, TestRenderDuration) {
     EXPECT_GE(duration, sleep_ms);
 }
 
+TEST_F(FrameMetaInfoTest, TestDeadlineOverrun) {
+    frameMetaInfo.setVsync(1000, 301, 16);
+    EXPECT_FALSE(frameMetaInfo.hasDeadline());
+
+    frameMetaInfo.setFrameTimeline(1016, 1032);
+    EXPECT_TRUE(frameMetaInfo.hasDeadline());
+    EXPECT_EQ(frameMetaInfo[FrameMetaIndex::ExpectedPresent], 1032);
+
+    frameMetaInfo.set(FrameMetaIndex::FrameFinished) = 1010;
+    EXPECT_EQ(frameMetaInfo.deadlineOverrun(), 0);
+
+    frameMetaInfo.set(FrameMetaIndex::FrameFinished) = 1020;
+    EXPECT_EQ(frameMetaInfo.deadlineOverrun(), 4);
+}
+
+TEST_F(FrameMetaInfoTest, TestLatencyGain) {
+    frameMetaInfo.setVsync(1000, 401, 16);
+    EXPECT_EQ(frameMetaInfo.latencyGain(), 0);
+
+    /* composed with the next vsync */
+    frameMetaInfo.setFrameTimeline(1016, 1032);
+    EXPECT_EQ(frameMetaInfo.presentLatency(), 32);
+    EXPECT_EQ(frameMetaInfo.latencyGain(), 0);
+
+    /* composed 4ms after the vsync */
+    frameMetaInfo.setFrameTimeline(1004, 1020);
+    EXPECT_EQ(frameMetaInfo.latencyGain(), 12);
+}
+
+TEST_F(FrameMetaInfoTest, TestInputLatency) {
+    frameMetaInfo.setVsync(1000, 501, 16);
+    EXPECT_FALSE(frameMetaInfo.hasInputEvent());
+    EXPECT_EQ(frameMetaInfo.inputLatency(), 0);
+
+    /* sampled 6ms before the vsync, shown at the expected present */
+    frameMetaInfo.setInputEvent(7, 994);
+    frameMetaInfo.setFrameTimeline(1016, 1032);
+    EXPECT_TRUE(frameMetaInfo.hasInputEvent());
+    EXPECT_EQ(frameMetaInfo.get(FrameMetaIndex::InputId), 7);
+    EXPECT_EQ(frameMetaInfo.inputLatency(), 38);
+}
+
 extern "C" int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
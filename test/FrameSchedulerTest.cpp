@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "../common/FrameScheduler.h"
+
+namespace os {
+namespace wm {
+
+class FrameSchedulerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        /* vsync at 1000us on a 16ms display */
+        mTimeline = makeFrameTimeline(1000, 16000, 0);
+    }
+
+    FrameScheduler mScheduler;
+    FrameTimeline mTimeline;
+};
+
+TEST_F(FrameSchedulerTest, Predict) {
+    EXPECT_EQ(mScheduler.predictDuration(), 0);
+
+    mScheduler.addSample(4000);
+    mScheduler.addSample(8000);
+    EXPECT_EQ(mScheduler.predictDuration(), 8000);
+
+    /* a fast frame alone doesn't lower the prediction below the average */
+    mScheduler.addSample(3000);
+    EXPECT_EQ(mScheduler.predictDuration(), 5000);
+}
+
+TEST_F(FrameSchedulerTest, SkipLateFrame) {
+    mScheduler.addSample(8000);
+
+    /* in time */
+    EXPECT_FALSE(mScheduler.shouldSkip(mTimeline, 2000));
+    /* woken 10ms late, 8ms more misses the deadline at 17000 */
+    EXPECT_TRUE(mScheduler.shouldSkip(mTimeline, 11000));
+    /* never twice in a row */
+    EXPECT_FALSE(mScheduler.shouldSkip(mTimeline, 11000));
+}
+
+TEST_F(FrameSchedulerTest, LongFrameNotSkipped) {
+    mScheduler.addSample(20000);
+
+    /* never fits the budget, waiting doesn't help */
+    EXPECT_FALSE(mScheduler.shouldSkip(mTimeline, 11000));
+}
+
+TEST_F(FrameSchedulerTest, EarlyStart) {
+    mScheduler.addSample(8000);
+    EXPECT_EQ(mScheduler.earlyStartTime(mTimeline), 0);
+
+    /* 20ms frame, done at the next deadline 33000 */
+    mScheduler.addSample(20000);
+    EXPECT_EQ(mScheduler.earlyStartTime(mTimeline), 13000);
+
+    /* longer than two periods, start right away */
+    mScheduler.reset();
+    mScheduler.addSample(40000);
+    EXPECT_EQ(mScheduler.earlyStartTime(mTimeline), 1000);
+}
+
+extern "C" int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os
@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 
+#include "../common/WindowUtils.h"
 #include "BaseWindow.h"
 #include "WindowManager.h"
 #include "app/Application.h"
@@ -23,6 +24,7 @@
 #include "app/Context.h"
 #include "app/ContextImpl.h"
 #include "app/UvLoop.h"
+#include "wm/VsyncRequestOps.h"
 
 namespace os {
 namespace wm {
@@ -101,8 +103,183 @@ TEST_F(IWindowManagerTest, RemoveWindow) {
     EXPECT_TRUE(status.isOk());
 }
 TEST_F(IWindowManagerTest, Relayout) {
-    // TODO
+    Status status = Status::ok();
+    int32_t result = 0;
+    sp<IWindow> w = mWindow->getIWindow();
+    LayoutParams lp = mWindow->getLayoutParams();
+    InputChannel* outInputChannel = new InputChannel();
+
+    status = mWindowManager->getService()->addWindowToken(mToken, 1, 1);
+    status = mWindowManager->getService()->addWindow(w, lp, 1, 0, 1, outInputChannel, &result);
+    EXPECT_TRUE(status.isOk());
+
+    SurfaceControl first;
+    status = mWindowManager->getService()->relayout(w, lp, 200, 200, LayoutParams::WINDOW_VISIBLE,
+                                                    &first, &result);
+    EXPECT_TRUE(status.isOk());
+
+    /* unchanged geometry keeps the surface */
+    SurfaceControl second;
+    status = mWindowManager->getService()->relayout(w, lp, 200, 200, LayoutParams::WINDOW_VISIBLE,
+                                                    &second, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_EQ(first.getHandle(), second.getHandle());
+
+    SurfaceControl third;
+    status = mWindowManager->getService()->relayout(w, lp, 100, 200, LayoutParams::WINDOW_VISIBLE,
+                                                    &third, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_NE(first.getHandle(), third.getHandle());
+
+    mWindowManager->getService()->removeWindow(w);
+}
+
+TEST_F(IWindowManagerTest, RelayoutLatency) {
+    Status status = Status::ok();
+    int32_t result = 0;
+    sp<IWindow> w = mWindow->getIWindow();
+    LayoutParams lp = mWindow->getLayoutParams();
+    InputChannel* outInputChannel = new InputChannel();
+    const int32_t loops = 20;
+
+    status = mWindowManager->getService()->addWindowToken(mToken, 1, 1);
+    status = mWindowManager->getService()->addWindow(w, lp, 1, 0, 1, outInputChannel, &result);
+    EXPECT_TRUE(status.isOk());
+
+    SurfaceControl first;
+    status = mWindowManager->getService()->relayout(w, lp, 200, 200, LayoutParams::WINDOW_VISIBLE,
+                                                    &first, &result);
+    EXPECT_TRUE(status.isOk());
+    ASSERT_FALSE(first.bufferIds().empty());
+
+    /* no new shared memory: same handle, same buffer names and keys */
+    auto sameBuffers = [&first](SurfaceControl& sc) {
+        const auto& ids = sc.bufferIds();
+        const auto& ref = first.bufferIds();
+        if (first.getHandle() != sc.getHandle() || ids.size() != ref.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (ids[i].mKey != ref[i].mKey || ids[i].mName != ref[i].mName) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    /* same geometry, surface is kept */
+    uint64_t start = curSysTimeUs();
+    for (int32_t i = 0; i < loops; i++) {
+        SurfaceControl sc;
+        status = mWindowManager->getService()->relayout(w, lp, 200, 200,
+                                                        LayoutParams::WINDOW_VISIBLE, &sc, &result);
+        EXPECT_TRUE(status.isOk());
+        EXPECT_TRUE(sameBuffers(sc));
+    }
+    uint64_t keepUs = (curSysTimeUs() - start) / loops;
+
+    /* visibility toggle, surface comes back from the pool */
+    start = curSysTimeUs();
+    for (int32_t i = 0; i < loops; i++) {
+        SurfaceControl hidden;
+        mWindowManager->getService()->relayout(w, lp, 200, 200, LayoutParams::WINDOW_GONE, &hidden,
+                                               &result);
+        SurfaceControl sc;
+        status = mWindowManager->getService()->relayout(w, lp, 200, 200,
+                                                        LayoutParams::WINDOW_VISIBLE, &sc, &result);
+        EXPECT_TRUE(status.isOk());
+        EXPECT_TRUE(sameBuffers(sc));
+    }
+    uint64_t toggleUs = (curSysTimeUs() - start) / loops;
+
+    /* alternate size, both surfaces are parked in turn */
+    SurfaceControl other;
+    mWindowManager->getService()->relayout(w, lp, 200, 100, LayoutParams::WINDOW_VISIBLE, &other,
+                                           &result);
+    EXPECT_NE(first.getHandle(), other.getHandle());
+    start = curSysTimeUs();
+    for (int32_t i = 0; i < loops; i++) {
+        SurfaceControl sc;
+        status = mWindowManager->getService()->relayout(w, lp, 200, (i % 2) ? 100 : 200,
+                                                        LayoutParams::WINDOW_VISIBLE, &sc, &result);
+        EXPECT_TRUE(status.isOk());
+        EXPECT_EQ((i % 2) ? other.getHandle() : first.getHandle(), sc.getHandle());
+    }
+    uint64_t resizeUs = (curSysTimeUs() - start) / loops;
+    printf("RelayoutLatency{ keepUs=%" PRIu64 ", toggleUs=%" PRIu64 ", resizeUs=%" PRIu64 " }\n",
+           keepUs, toggleUs, resizeUs);
+    mWindowManager->getService()->removeWindow(w);
 }
+#if defined(CONFIG_ENABLE_WINDOW_ADAPTIVE_BUFFER) && CONFIG_ENABLE_WINDOW_SURFACE_BUDGET > 0
+TEST_F(IWindowManagerTest, BudgetKeepsShownBuffers) {
+    Status status = Status::ok();
+    int32_t result = 0;
+    sp<IWindow> w = mWindow->getIWindow();
+    LayoutParams lp = mWindow->getLayoutParams();
+    InputChannel* outInputChannel = new InputChannel();
+
+    status = mWindowManager->getService()->addWindowToken(mToken, 1, 1);
+    status = mWindowManager->getService()->addWindow(w, lp, 1, 0, 1, outInputChannel, &result);
+    EXPECT_TRUE(status.isOk());
+
+    SurfaceControl probe;
+    mWindowManager->getService()->relayout(w, lp, 100, 100, LayoutParams::WINDOW_VISIBLE, &probe,
+                                           &result);
+    uint32_t lineBytes = probe.getBufferSize() / 100;
+    uint32_t budget = CONFIG_ENABLE_WINDOW_SURFACE_BUDGET * 1024;
+    /* a buffer is 2/9 of the budget, two windows fit with 4 buffers but not with 5 */
+    int32_t height = lineBytes > 0 ? budget * 2 / 9 / lineBytes : 0;
+    if (height <= 0) {
+        GTEST_SKIP() << "surface budget is too small";
+    }
+
+    SurfaceControl first;
+    status = mWindowManager->getService()->relayout(w, lp, 100, height,
+                                                    LayoutParams::WINDOW_VISIBLE, &first, &result);
+    EXPECT_TRUE(status.isOk());
+    SurfaceControl grown;
+    status = mWindowManager->getService()->updateBufferCount(w, 3, &grown, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_EQ(grown.bufferIds().size(), 3u);
+
+    /* the second surface only fits once the first client gives its third buffer back */
+    std::shared_ptr<BaseWindow> window2 = mWindowManager->newWindow(mContext);
+    window2->setLayoutParams(mLayoutParam);
+    sp<IWindow> w2 = window2->getIWindow();
+    InputChannel* outInputChannel2 = new InputChannel();
+    status = mWindowManager->getService()->addWindow(w2, lp, 1, 0, 1, outInputChannel2, &result);
+    EXPECT_TRUE(status.isOk());
+
+    SurfaceControl refused;
+    status = mWindowManager->getService()->relayout(w2, lp, 100, height,
+                                                    LayoutParams::WINDOW_VISIBLE, &refused, &result);
+    EXPECT_FALSE(status.isOk());
+
+    /* the shown window keeps all of its buffers */
+    SurfaceControl kept;
+    status = mWindowManager->getService()->relayout(w, lp, 100, height,
+                                                    LayoutParams::WINDOW_VISIBLE, &kept, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_EQ(kept.getHandle(), first.getHandle());
+    EXPECT_EQ(kept.bufferIds().size(), 3u);
+
+    SurfaceControl shrunk;
+    status = mWindowManager->getService()->updateBufferCount(w, 2, &shrunk, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_EQ(shrunk.bufferIds().size(), 2u);
+
+    SurfaceControl second;
+    status = mWindowManager->getService()->relayout(w2, lp, 100, height,
+                                                    LayoutParams::WINDOW_VISIBLE, &second, &result);
+    EXPECT_TRUE(status.isOk());
+    EXPECT_EQ(result, 0);
+    EXPECT_EQ(second.bufferIds().size(), 2u);
+
+    mWindowManager->getService()->removeWindow(w2);
+    mWindowManager->getService()->removeWindow(w);
+}
+#endif
+
 TEST_F(IWindowManagerTest, IsWindowToken) {
     // TODO
 }
@@ -133,7 +310,29 @@ TEST_F(IWindowManagerTest, ApplyTransaction) {
     // TODO
 }
 TEST_F(IWindowManagerTest, RequestVsync) {
-    // TODO
+    Status status = Status::ok();
+    int32_t result = 0;
+    sp<IWindow> w = mWindow->getIWindow();
+    LayoutParams lp = mWindow->getLayoutParams();
+    InputChannel* outInputChannel = new InputChannel();
+
+    status = mWindowManager->getService()->addWindowToken(mToken, 1, 1);
+    status = mWindowManager->getService()->addWindow(w, lp, 1, 0, 1, outInputChannel, &result);
+    ASSERT_TRUE(status.isOk());
+
+    auto service = mWindowManager->getService();
+    EXPECT_TRUE(service->requestVsync(w, periodicVsync(2)).isOk());
+    EXPECT_TRUE(service->requestVsync(w, periodicVsync(VSYNC_MAX_DIVISOR)).isOk());
+
+    // divisors past the limit would overflow the vsync timer period
+    auto tooSlow = static_cast<VsyncRequest>(VSYNC_MAX_DIVISOR + 1);
+    EXPECT_FALSE(service->requestVsync(w, tooSlow).isOk());
+    EXPECT_FALSE(service->requestVsync(w, static_cast<VsyncRequest>(INT32_MAX)).isOk());
+    EXPECT_FALSE(service->requestVsync(w, static_cast<VsyncRequest>(-3)).isOk());
+    EXPECT_EQ(periodicVsync(1000), periodicVsync(VSYNC_MAX_DIVISOR));
+
+    EXPECT_TRUE(service->requestVsync(w, VsyncRequest::VSYNC_REQ_NONE).isOk());
+    delete outInputChannel;
 }
 
 extern "C" int main(int argc, char** argv) {
@@ -82,6 +82,82 @@ TEST_F(InputMonitorTest, receiveMessage) {
     EXPECT_EQ(im.pointer.y, gTestMessage.pointer.y);
 }
 
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_RING
+TEST_F(InputMonitorTest, ringFromServicePath) {
+    /* named like the channels of addWindow and monitorInput */
+    std::string name = "/var/run/xms:event-" + std::to_string(getpid()) + "-1";
+    auto dispatcher = InputDispatcher::create(name);
+    ASSERT_NE(dispatcher, nullptr);
+    EXPECT_EQ(dispatcher->getInputChannel().isRing(), true);
+
+    InputChannel* channel = new InputChannel();
+    channel->copyFrom(dispatcher->getInputChannel());
+    auto monitor = std::make_shared<InputMonitor>(new BBinder(), channel);
+
+    InputMessage msg;
+    EXPECT_EQ(dispatcher->sendMessage(&gTestMessage), 0);
+    EXPECT_EQ(monitor->receiveMessage(&msg), true);
+    EXPECT_EQ(msg.pointer.x, gTestMessage.pointer.x);
+    EXPECT_EQ(monitor->receiveMessage(&msg), false);
+}
+#endif
+
+TEST_F(InputMonitorTest, receiveBurst) {
+    auto dispatcher = InputDispatcher::create("input-gesture-test4");
+    EXPECT_NE(dispatcher, nullptr);
+
+    InputChannel* channel = new InputChannel();
+    channel->copyFrom(dispatcher->getInputChannel());
+    auto monitor = std::make_shared<InputMonitor>(new BBinder(), channel);
+
+    /* a burst of taps is received in order, then the channel runs dry */
+    InputMessage msg = gTestMessage;
+    for (int32_t i = 0; i < 10; i++) {
+        msg.pointer.x = i;
+        msg.state = (i & 1) ? INPUT_MESSAGE_STATE_RELEASED : INPUT_MESSAGE_STATE_PRESSED;
+        EXPECT_EQ(dispatcher->sendMessage(&msg), 0);
+    }
+
+    for (int32_t i = 0; i < 10; i++) {
+        EXPECT_EQ(monitor->receiveMessage(&msg), true);
+        EXPECT_EQ(msg.pointer.x, i);
+    }
+    EXPECT_EQ(monitor->receiveMessage(&msg), false);
+}
+
+#ifdef CONFIG_ENABLE_WINDOW_INPUT_COALESCE
+TEST_F(InputMonitorTest, coalesceMoves) {
+    /* created as WindowState::createInputDispatcher does for addWindow */
+    std::string name = "/var/run/xms:event-" + std::to_string(getpid()) + "-5";
+    auto dispatcher = InputDispatcher::create(name);
+    ASSERT_NE(dispatcher, nullptr);
+    ASSERT_EQ(dispatcher->getInputChannel().isRing(), true);
+
+    InputChannel* channel = new InputChannel();
+    channel->copyFrom(dispatcher->getInputChannel());
+    auto monitor = std::make_shared<InputMonitor>(new BBinder(), channel);
+
+    /* press, moves, release: the moves still queued collapse into the latest one */
+    InputMessage msg = gTestMessage;
+    for (int32_t i = 0; i < 10; i++) {
+        msg.pointer.x = i;
+        EXPECT_EQ(dispatcher->sendMessage(&msg), 0);
+    }
+    msg.state = INPUT_MESSAGE_STATE_RELEASED;
+    EXPECT_EQ(dispatcher->sendMessage(&msg), 0);
+
+    EXPECT_EQ(monitor->receiveMessage(&msg), true);
+    EXPECT_EQ(msg.state, INPUT_MESSAGE_STATE_PRESSED);
+    EXPECT_EQ(msg.pointer.x, 0);
+    EXPECT_EQ(monitor->receiveMessage(&msg), true);
+    EXPECT_EQ(msg.state, INPUT_MESSAGE_STATE_PRESSED);
+    EXPECT_EQ(msg.pointer.x, 9);
+    EXPECT_EQ(monitor->receiveMessage(&msg), true);
+    EXPECT_EQ(msg.state, INPUT_MESSAGE_STATE_RELEASED);
+    EXPECT_EQ(monitor->receiveMessage(&msg), false);
+}
+#endif
+
 TEST_F(InputMonitorTest, start) {
     auto input = WindowManager::monitorInput("input-gesture-test3", 0);
     EXPECT_NE(input, nullptr);
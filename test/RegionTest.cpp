@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "wm/Region.h"
+
+using namespace os::wm;
+
+TEST(RegionTest, KeepsSeparateCorners) {
+    Region region;
+    region.orSelf(Rect(0, 0, 9, 9));
+    region.orSelf(Rect(450, 450, 465, 465));
+
+    ASSERT_EQ(region.size(), 2u);
+    EXPECT_EQ(region[0].right, 9);
+    EXPECT_EQ(region[1].left, 450);
+}
+
+TEST(RegionTest, MergesOverlapping) {
+    Region region;
+    region.orSelf(Rect(0, 0, 99, 99));
+    region.orSelf(Rect(10, 10, 20, 20));
+    EXPECT_EQ(region.size(), 1u);
+
+    region.orSelf(Rect(50, 0, 149, 99));
+    ASSERT_EQ(region.size(), 1u);
+    EXPECT_EQ(region[0].right, 149);
+}
+
+TEST(RegionTest, MergesWhenFull) {
+    Region region;
+    for (int32_t i = 0; i < REGION_MAX_RECTS + 2; i++) {
+        region.orSelf(Rect(i * 100, i * 100, i * 100 + 9, i * 100 + 9));
+    }
+
+    EXPECT_EQ(region.size(), (uint32_t)REGION_MAX_RECTS);
+    Rect bounds = region.bounds();
+    EXPECT_EQ(bounds.left, 0);
+    EXPECT_EQ(bounds.bottom, (REGION_MAX_RECTS + 1) * 100 + 9);
+}
+
+TEST(RegionTest, IgnoresEmptyRect) {
+    Region region;
+    region.orSelf(Rect(10, 10, 9, 9));
+    EXPECT_TRUE(region.isEmpty());
+}
+
+TEST(RegionTest, Parcel) {
+    Region region;
+    region.orSelf(Rect(0, 0, 9, 9));
+    region.orSelf(Rect(200, 200, 209, 209));
+
+    Parcel parcel;
+    EXPECT_EQ(region.writeToParcel(&parcel), android::OK);
+    parcel.setDataPosition(0);
+
+    Region result;
+    EXPECT_EQ(result.readFromParcel(&parcel), android::OK);
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_EQ(result[1].top, 200);
+}
+
+extern "C" int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include "wm/VsyncChannel.h"
+
+namespace os {
+namespace wm {
+
+class VsyncChannelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(mPage.createPage("xms:vsync-test-" + std::to_string(getpid())));
+        ASSERT_TRUE(mServer.attach(mPage));
+        /* what the client gets from the parcel */
+        ASSERT_TRUE(mClient.copyFrom(mServer));
+        ASSERT_TRUE(mClient.map());
+    }
+    void TearDown() override {}
+
+    VsyncChannel mPage;
+    VsyncChannel mServer;
+    VsyncChannel mClient;
+};
+
+TEST_F(VsyncChannelTest, PublishReceive) {
+    uint32_t seq = 0;
+    FrameTimeline timeline;
+
+    mPage.publish(1, makeFrameTimeline(0x100000002LL, 16000, 0));
+    EXPECT_TRUE(mServer.signal());
+    EXPECT_TRUE(mClient.receive(&seq, &timeline));
+    EXPECT_EQ(seq, 1u);
+    EXPECT_EQ(timeline.mVsyncTime, 0x100000002LL);
+    EXPECT_EQ(timeline.mDeadline, 0x100000002LL + 16000);
+    EXPECT_EQ(timeline.mExpectedPresentTime, 0x100000002LL + 32000);
+}
+
+TEST_F(VsyncChannelTest, PhaseLead) {
+    uint32_t seq = 0;
+    FrameTimeline timeline;
+
+    /* composition 4ms after the apps wake up */
+    mPage.publish(1, makeFrameTimeline(1000, 16000, 4000));
+    EXPECT_TRUE(mServer.signal());
+    EXPECT_TRUE(mClient.receive(&seq, &timeline));
+    EXPECT_EQ(timeline.mDeadline, 5000);
+    EXPECT_EQ(timeline.mExpectedPresentTime, 21000);
+}
+
+TEST_F(VsyncChannelTest, NoSignalNoFrame) {
+    uint32_t seq = 0;
+
+    mPage.publish(1, makeFrameTimeline(1000, 16000, 0));
+    EXPECT_FALSE(mClient.receive(&seq, nullptr));
+}
+
+TEST_F(VsyncChannelTest, MissedSignalsMerged) {
+    uint32_t seq = 0;
+    FrameTimeline timeline;
+
+    mPage.publish(1, makeFrameTimeline(1000, 16000, 0));
+    EXPECT_TRUE(mServer.signal());
+    mPage.publish(2, makeFrameTimeline(2000, 16000, 0));
+    EXPECT_TRUE(mServer.signal());
+
+    EXPECT_TRUE(mClient.receive(&seq, &timeline));
+    EXPECT_EQ(seq, 2u);
+    EXPECT_EQ(timeline.mVsyncTime, 2000);
+    EXPECT_FALSE(mClient.receive(&seq, &timeline));
+}
+
+TEST_F(VsyncChannelTest, ReadOnlyPage) {
+    int fd = mClient.getPageFd();
+    ASSERT_NE(fd, -1);
+    EXPECT_EQ(fcntl(fd, F_GETFL) & O_ACCMODE, O_RDONLY);
+    EXPECT_EQ(mmap(nullptr, sizeof(VsyncPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0),
+              MAP_FAILED);
+}
+
+TEST_F(VsyncChannelTest, ReleaseChannel) {
+    mClient.release();
+    EXPECT_FALSE(mClient.isValid());
+    EXPECT_FALSE(mClient.receive(nullptr, nullptr));
+}
+
+extern "C" int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os